@@ -1,16 +1,11 @@
-#version 150
+#version 120
 
-// TODO: Implement
-
-
-in vec4 vColor;
-out vec4 outputColor;
+varying vec4 vColor;
 
 void main() {
+    // round sprites
     float dist = length(gl_PointCoord - vec2(0.5));
     if (dist > 0.5) discard;
 
-    outputColor = vColor;
+    gl_FragColor = vColor;
 }
-
-
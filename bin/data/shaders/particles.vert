@@ -1,15 +1,12 @@
-#version 150
-// TODO: implement
+#version 120
 
-in vec4 position;
-in vec4 color;
-in float size;
+// per-particle point size, color and position come from ParticleVertexBuffer
+attribute float size;
 
-out vec4 vColor;
+varying vec4 vColor;
 
 void main() {
-    gl_Position = modelViewProjectionMatrix * position;
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
     gl_PointSize = size;
-    vColor = color;
+    vColor = gl_Color;
 }
-
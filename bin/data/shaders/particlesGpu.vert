@@ -0,0 +1,26 @@
+#version 120
+
+// Draws GpuParticleSystem: gl_Vertex.xy is the particle's texel in the state textures.
+
+uniform sampler2D stateTex; // posX, posY, velX, velY
+uniform sampler2D colorTex; // r, g, b, size
+uniform vec2      drawScale;
+
+varying vec4 vColor;
+
+void main() {
+    vec4 state = texture2DLod(stateTex, gl_Vertex.xy, 0.0);
+    vec4 color = texture2DLod(colorTex, gl_Vertex.xy, 0.0);
+
+    if (color.a <= 0.0) {
+        // hidden, move it outside the clip volume
+        gl_Position  = vec4(2.0, 2.0, 2.0, 1.0);
+        gl_PointSize = 1.0;
+        vColor       = vec4(0.0);
+        return;
+    }
+
+    gl_Position  = gl_ModelViewProjectionMatrix * vec4(state.xy * drawScale, 0.0, 1.0);
+    gl_PointSize = color.a;
+    vColor       = vec4(color.rgb, 1.0);
+}
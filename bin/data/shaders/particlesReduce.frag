@@ -0,0 +1,21 @@
+#version 120
+
+// Sums one row of flow contributions into a 2 x rows target: x = 0 left side, x = 1 right.
+// Output is (sumX, sumY, count); the CPU adds up the rows.
+
+uniform sampler2D contributionTex; // flowX, flowY, isLeft, valid
+uniform vec2      stateSize;
+
+void main() {
+    float side = floor(gl_FragCoord.x);
+    float v    = (floor(gl_FragCoord.y) + 0.5) / stateSize.y;
+
+    vec3 sum = vec3(0.0);
+    for (float x = 0.0; x < stateSize.x; x += 1.0) {
+        vec4  c     = texture2D(contributionTex, vec2((x + 0.5) / stateSize.x, v));
+        float match = side < 0.5 ? c.z : 1.0 - c.z;
+        sum += vec3(c.xy, 1.0) * (match * c.w);
+    }
+
+    gl_FragColor = vec4(sum, 1.0);
+}
@@ -0,0 +1,80 @@
+#version 120
+
+// One fragment per particle: the GPU version of ParticleSystem::updateParticles() followed by
+// updateColors(). Writes the new state, the flow contribution for the paddle reduction and
+// the camera color / point size at the new position.
+
+uniform sampler2D stateTex;  // posX, posY, velX, velY
+uniform sampler2D colorTex;  // r, g, b, size
+uniform sampler2D baseTex;   // baseX, baseY
+uniform sampler2D flowTex;   // Farneback flow, RG32F
+uniform sampler2D cameraTex;
+
+uniform vec2  stateSize;
+uniform float particleCount;
+uniform vec2  sourceSize;
+uniform vec2  flowSize;
+uniform vec2  cameraSize;
+uniform float minLengthSquared;
+uniform float damping;
+uniform float flowGain;
+uniform float springGain;
+uniform float moveGain;
+uniform float particleSize;
+uniform bool  mirror;
+
+// C-style (int) cast
+float truncate(float v) {
+    return v < 0.0 ? -floor(-v) : floor(v);
+}
+
+// bilinear between flow cell centers, the same footprint as ParticleSystem::bilinearCell(). Four
+// explicit taps on the GL_NEAREST texture, float textures are not filterable everywhere
+vec2 sampleFlow(vec2 pos) {
+    vec2 uv     = clamp(pos / sourceSize * flowSize - 0.5, vec2(0.0), flowSize - 1.0);
+    vec2 cell   = min(floor(uv), max(flowSize - 2.0, vec2(0.0)));
+    vec2 weight = uv - cell;
+    vec2 c00    = texture2D(flowTex, (cell + vec2(0.5, 0.5)) / flowSize).xy;
+    vec2 c10    = texture2D(flowTex, (cell + vec2(1.5, 0.5)) / flowSize).xy;
+    vec2 c01    = texture2D(flowTex, (cell + vec2(0.5, 1.5)) / flowSize).xy;
+    vec2 c11    = texture2D(flowTex, (cell + vec2(1.5, 1.5)) / flowSize).xy;
+    return mix(mix(c00, c10, weight.x), mix(c01, c11, weight.x), weight.y);
+}
+
+void main() {
+    vec2  texel = floor(gl_FragCoord.xy);
+    vec2  uv    = (texel + 0.5) / stateSize;
+    float index = texel.y * stateSize.x + texel.x;
+
+    vec4 state = texture2D(stateTex, uv);
+    vec2 pos   = state.xy;
+    vec2 vel   = state.zw;
+    vec2 base  = texture2D(baseTex, uv).xy;
+    float size = texture2D(colorTex, uv).a;
+
+    vec2 flow = sampleFlow(pos);
+    if (!(dot(flow, flow) > minLengthSquared)) {
+        flow = vec2(0.0);
+    }
+    float isLeft = pos.x + size < sourceSize.x * 0.5 ? 1.0 : 0.0;
+
+    vel = vel / damping + flow * flowGain;
+    vec2 toBase = base - pos;
+    if (dot(toBase, toBase) > 0.01) {
+        vel += toBase * springGain;
+    }
+    vel *= 0.99;
+    pos += vel * moveGain;
+
+    // camera color at the new position, out of bounds particles get size 0
+    vec2 pixel  = vec2(mirror ? cameraSize.x - truncate(pos.x) : truncate(pos.x), truncate(pos.y));
+    vec4 color  = vec4(0.0);
+    if (all(greaterThanEqual(pixel, vec2(0.0))) && all(lessThan(pixel, cameraSize))) {
+        vec3 rgb = texture2D(cameraTex, (pixel + 0.5) / cameraSize).rgb;
+        color    = vec4(rgb, particleSize * (max(rgb.r, max(rgb.g, rgb.b)) * 0.8 + 0.2));
+    }
+
+    gl_FragData[0] = vec4(pos, vel);
+    gl_FragData[1] = vec4(flow, isLeft, index < particleCount ? 1.0 : 0.0);
+    gl_FragData[2] = color;
+}
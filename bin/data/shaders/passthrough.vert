@@ -0,0 +1,6 @@
+#version 120
+
+// full-screen passes over the particle state textures
+void main() {
+    gl_Position = ftransform();
+}
@@ -0,0 +1,107 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counting replacement for the global allocator so benchmarks can report allocations per
+// frame. Every thread counts into its own counter, so an allocation only pays for a plain
+// thread-local increment and threads never share a cache line; allocationCount() sums them up.
+// Counters are never freed: a thread that exits hands its counter (and its count) on to the
+// next new thread, so their number stays at the most threads alive at once.
+namespace {
+
+struct Counter {
+	std::atomic<uint64_t> count { 0 };     // written by the owning thread only
+	std::atomic<bool>     owned { false };
+	Counter              *next = nullptr;
+};
+
+std::atomic<Counter *> counters { nullptr }; // every counter, newest first
+std::atomic<uint64_t>  unowned { 0 };        // allocations of exiting threads, after their release
+
+thread_local Counter *local    = nullptr;
+thread_local bool     released = false;
+
+// gives the thread's counter back when the thread exits
+struct Release {
+	~Release() {
+		if (local) {
+			local->owned.store(false, std::memory_order_release);
+			local = nullptr;
+		}
+		released = true;
+	}
+};
+thread_local Release release;
+
+Counter *claim() {
+	for (Counter *c = counters.load(std::memory_order_acquire); c; c = c->next) {
+		bool expected = false;
+		if (!c->owned.load(std::memory_order_relaxed)
+		    && c->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+			return c;
+		}
+	}
+
+	// not through operator new, that would count into the counter being made
+	void *memory = std::malloc(sizeof(Counter));
+	if (!memory) {
+		return nullptr;
+	}
+	Counter *c = new (memory) Counter();
+	c->owned.store(true, std::memory_order_relaxed);
+	c->next = counters.load(std::memory_order_relaxed);
+	while (!counters.compare_exchange_weak(c->next, c, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+	return c;
+}
+
+void countAllocation() {
+	if (!local) {
+		if (released || !(local = claim())) {
+			unowned.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		(void)&release; // constructs it, so the counter is released at thread exit
+	}
+	local->count.store(local->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+uint64_t Benchmark::allocationCount() {
+	uint64_t sum = unowned.load(std::memory_order_relaxed);
+	for (Counter *c = counters.load(std::memory_order_acquire); c; c = c->next) {
+		sum += c->count.load(std::memory_order_relaxed);
+	}
+	return sum;
+}
+
+void *operator new(std::size_t size) {
+	countAllocation();
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Small timing helper for the in-app microbenchmarks. Every run() warms up once, times
+// each iteration separately and logs mean / percentiles so two variants of the same stage
+// can be compared side by side.
+namespace Benchmark {
+
+// number of global operator new calls so far, on all threads (see Benchmark.cpp)
+uint64_t allocationCount();
+
+struct Result {
+	std::string name;
+	int         iterations = 0;
+	double      meanMs     = 0.0;
+	double      minMs      = 0.0;
+	double      p50Ms      = 0.0;
+	double      p95Ms      = 0.0;
+	double      p99Ms      = 0.0;
+};
+
+// expects samples sorted ascending
+inline double percentile(const std::vector<double> &samples, double pct) {
+	if (samples.empty()) {
+		return 0.0;
+	}
+	size_t idx = std::min(samples.size() - 1, (size_t)(pct / 100.0 * (samples.size() - 1) + 0.5));
+	return samples[idx];
+}
+
+inline Result summarize(const std::string &name, std::vector<double> &samples) {
+	Result r;
+	r.name       = name;
+	r.iterations = samples.size();
+	if (samples.empty()) {
+		return r;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double s : samples) {
+		sum += s;
+	}
+	r.meanMs = sum / samples.size();
+	r.minMs  = samples.front();
+	r.p50Ms  = percentile(samples, 50);
+	r.p95Ms  = percentile(samples, 95);
+	r.p99Ms  = percentile(samples, 99);
+	return r;
+}
+
+inline void log(const Result &r) {
+	ofLogNotice("Benchmark") << r.name << ": mean " << ofToString(r.meanMs, 3) << " ms, min " << ofToString(r.minMs, 3)
+	                         << ", p50 " << ofToString(r.p50Ms, 3) << ", p95 " << ofToString(r.p95Ms, 3) << ", p99 "
+	                         << ofToString(r.p99Ms, 3) << " (" << r.iterations << " runs)";
+}
+
+template <typename F>
+Result run(const std::string &name, int iterations, F &&fn) {
+	std::vector<double> samples;
+	samples.reserve(iterations);
+
+	fn(); // warm-up, fills caches and lazily allocated buffers
+
+	for (int i = 0; i < iterations; i++) {
+		auto t0 = std::chrono::steady_clock::now();
+		fn();
+		samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+	}
+
+	Result r = summarize(name, samples);
+	log(r);
+	return r;
+}
+
+}
@@ -0,0 +1,423 @@
+#include "BenchmarkApp.h"
+#include "Benchmark.h"
+#include "PerfCounters.h"
+
+#include <chrono>
+#include <thread>
+
+void BenchmarkApp::setup() {
+	ofSetFrameRate(0);
+	ofSetLogLevel(OF_LOG_NOTICE);
+}
+
+void BenchmarkApp::update() {
+	if (bDone) {
+		return;
+	}
+	bDone = true;
+
+	ofJson report;
+	report["timestamp"]    = ofGetTimestampString("%Y-%m-%d %H:%M:%S");
+	report["source"]       = settings.sourceSpec;
+	report["frames"]       = settings.frames;
+	report["trackerCheck"] = checkTracker();
+	report["cases"]        = ofJson::array();
+
+	for (float downScale : settings.downScales) {
+		for (int spacing : settings.spacings) {
+			report["cases"].push_back(runCase(spacing, downScale));
+		}
+	}
+
+	if (ofSavePrettyJson(settings.outputPath, report)) {
+		ofLogNotice("BenchmarkApp") << "Results written to " << ofToDataPath(settings.outputPath, true);
+	} else {
+		ofLogError("BenchmarkApp") << "Could not write " << settings.outputPath;
+	}
+
+	ofExit(report["trackerCheck"]["passed"].get<bool>() ? 0 : 1);
+}
+
+// DetectionTracker on scripted detections, one update every 0.1 s: a box at constant velocity,
+// the same box missing from one update, and two boxes of the same class crossing each other.
+// Checks track ids and predicted positions, every failed expectation is logged and listed.
+ofJson BenchmarkApp::checkTracker() {
+	const double step = 0.1;
+
+	std::vector<std::string> failures;
+	auto expect = [&failures](bool ok, const std::string &what) {
+		if (!ok) {
+			ofLogError("BenchmarkApp") << "Tracker check failed: " << what;
+			failures.push_back(what);
+		}
+	};
+	auto box = [](float x, float y) {
+		yolo5ImageClassify::Result result;
+		result.rect       = ofRectangle(x, y, 100, 100);
+		result.confidence = 0.9f;
+		result.label      = "person";
+		return result;
+	};
+	auto trackAt = [](const DetectionTracker &tracker, float x) -> const DetectionTracker::Track * {
+		for (const DetectionTracker::Track &track : tracker.getTracks()) {
+			if (std::abs(track.rect.x - x) < 0.5f) {
+				return &track;
+			}
+		}
+		return nullptr;
+	};
+
+	// constant motion, 200 px/s to the right
+	DetectionTracker single;
+	for (int i = 0; i <= 5; i++) {
+		single.update({ box(100 + 20 * i, 100) }, i * step);
+	}
+	const DetectionTracker::Track *track = trackAt(single, 200);
+	int                            id    = track ? track->id : -1;
+	expect(single.getTracks().size() == 1 && track, "constant motion keeps one track");
+	single.predict(6 * step);
+	expect(track && std::abs(track->predicted.x - 220) < 0.5f, "constant motion predicts x 220 at 0.6 s");
+
+	// one update without the box: the track coasts, then picks the box up again under its id
+	single.update({}, 6 * step);
+	single.predict(6.5 * step);
+	track = single.getTracks().size() == 1 ? &single.getTracks()[0] : nullptr;
+	expect(track && std::abs(track->predicted.x - 230) < 0.5f, "missed update predicts x 230 at 0.65 s");
+	single.update({ box(240, 100) }, 7 * step);
+	track = trackAt(single, 240);
+	expect(single.getTracks().size() == 1 && track && track->id == id, "missed update keeps the track id");
+
+	// crossing at 300 px/s each, overlapping around 1 s; listed right to left so order does not help
+	DetectionTracker crossing;
+	for (int i = 0; i <= 20; i++) {
+		crossing.update({ box(600 - 30 * i, 140), box(30 * i, 100) }, i * step);
+		if (i == 0) {
+			track = trackAt(crossing, 0);
+			id    = track ? track->id : -1;
+		}
+	}
+	crossing.predict(21 * step);
+	const DetectionTracker::Track *right = trackAt(crossing, 600);
+	const DetectionTracker::Track *left  = trackAt(crossing, 0);
+	expect(crossing.getTracks().size() == 2 && right && left, "crossing keeps two tracks");
+	expect(right && right->id == id, "crossing keeps the left-to-right id");
+	expect(right && std::abs(right->predicted.x - 630) < 0.5f, "crossing predicts x 630 for the left-to-right box");
+	expect(left && std::abs(left->predicted.x + 30) < 0.5f, "crossing predicts x -30 for the right-to-left box");
+
+	ofLogNotice("BenchmarkApp") << "Tracker check " << (failures.empty() ? "passed" : "failed");
+	return ofJson { { "passed", failures.empty() }, { "failures", failures } };
+}
+
+ofJson BenchmarkApp::runCase(int spacing, float downScale) {
+	using clock = std::chrono::steady_clock;
+
+	// a fresh source per case, so every case sees the same frames
+	std::unique_ptr<FrameSource> source = FrameSource::create(settings.sourceSpec);
+	source->setFreeRun(true);
+	if (!source->setup(1280, 720)) {
+		ofLogError("BenchmarkApp") << "Frame source " << settings.sourceSpec << " failed";
+		return ofJson();
+	}
+
+	int sourceWidth  = source->getWidth();
+	int sourceHeight = source->getHeight();
+
+	VisionPipeline vision;
+	vision.settings.cvDownScale         = downScale;
+	vision.flowEngine.settings.backend = settings.flowBackend;
+	vision.setup(sourceWidth, sourceHeight, false);
+	vision.allocate();
+
+	ParticleSystem particles;
+	particles.generateParticles(sourceWidth, sourceHeight, spacing);
+	particles.setThreadCount(settings.threads);
+
+	const float deltaTime        = 1.0f / 60.0f;
+	const float minLengthSquared = 0.7f * 0.7f;
+	const float particleSize     = 8.0f;
+
+	std::vector<double> samples[STAGE_COUNT];
+	for (auto &s : samples) {
+		s.reserve(settings.frames);
+	}
+
+	uint64_t allocations = 0;
+	auto     runStart    = clock::now();
+
+	for (int frame = 0; frame < settings.warmupFrames + settings.frames; frame++) {
+		if (frame == settings.warmupFrames) {
+			allocations = Benchmark::allocationCount();
+			runStart    = clock::now();
+		}
+
+		double times[STAGE_COUNT];
+		auto   t0  = clock::now();
+		auto   lap = [&](int stage) {
+			auto t1      = clock::now();
+			times[stage] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+			t0           = t1;
+		};
+
+		source->update();
+		lap(STAGE_CAPTURE);
+
+		vision.processFrame(source->getPixels());
+		lap(STAGE_PROCESS);
+
+		vision.calculateOpticalFlow();
+		lap(STAGE_FLOW);
+
+		particles.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+		                          vision.settings.bMirror, source->getPixels(), particleSize);
+		lap(STAGE_PARTICLES);
+
+		particles.buildMesh(1.0f, 1.0f);
+		lap(STAGE_MESH);
+
+		if (frame >= settings.warmupFrames) {
+			for (int s = 0; s < STAGE_COUNT; s++) {
+				samples[s].push_back(times[s]);
+			}
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(clock::now() - runStart).count();
+	allocations    = Benchmark::allocationCount() - allocations;
+
+	ofJson result;
+	result["spacing"]             = spacing;
+	result["cvDownScale"]         = downScale;
+	result["particles"]           = particles.getParticleCount();
+	result["throughputFps"]       = seconds > 0.0 ? settings.frames / seconds : 0.0;
+	result["allocationsPerFrame"] = (double)allocations / settings.frames;
+	result["copiedBytesPerFrame"] = vision.getCopiedBytes();
+
+	// scalar vs SSE particle kernel, same start state and the last flow field for both
+	{
+		ParticleSystem scalar, simd;
+		scalar.generateParticles(sourceWidth, sourceHeight, spacing);
+		simd.generateParticles(sourceWidth, sourceHeight, spacing);
+		scalar.setUseSimd(false);
+		scalar.setThreadCount(1);
+		simd.setThreadCount(1);
+
+		auto step = [&](ParticleSystem &system) {
+			system.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+			                       vision.settings.bMirror);
+		};
+		Benchmark::Result scalarRun = Benchmark::run("particles scalar", 100, [&] { step(scalar); });
+		Benchmark::Result simdRun   = Benchmark::run("particles simd", 100, [&] { step(simd); });
+		float             maxDiff   = simd.maxPositionDifference(scalar);
+
+		// bilinear flow sampling (default) vs the nearest cell lookup
+		ParticleSystem nearest;
+		nearest.generateParticles(sourceWidth, sourceHeight, spacing);
+		nearest.setThreadCount(1);
+		nearest.setBilinearFlow(false);
+		Benchmark::Result nearestRun = Benchmark::run("particles nearest flow", 100, [&] { step(nearest); });
+
+		// fused update + color sampling vs the update followed by the separate color pass
+		const ofPixels   &camera      = source->getPixels();
+		Benchmark::Result separateRun = Benchmark::run("particles + colors", 100, [&] {
+			step(simd);
+			simd.updateColors(camera, particleSize, vision.settings.bMirror);
+		});
+		Benchmark::Result fusedRun = Benchmark::run("particles fused colors", 100, [&] {
+			simd.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+			                     vision.settings.bMirror, camera, particleSize);
+		});
+
+		double count = simd.getParticleCount();
+		result["particleKernel"] = { { "scalarParticlesPerMs", scalarRun.meanMs > 0 ? count / scalarRun.meanMs : 0.0 },
+			                         { "simdParticlesPerMs", simdRun.meanMs > 0 ? count / simdRun.meanMs : 0.0 },
+			                         { "maxPositionDifference", maxDiff },
+			                         { "nearestFlowMs", nearestRun.meanMs },
+			                         { "bilinearFlowMs", simdRun.meanMs },
+			                         { "separateColorsMs", separateRun.meanMs },
+			                         { "fusedColorsMs", fusedRun.meanMs } };
+	}
+
+	// every flow backend on the same frame pair, with the mean vertical motion of each half that
+	// the paddles are driven by, to compare against Farneback
+	{
+		source->update();
+		vision.processFrame(source->getPixels());
+		const cv::Mat &previous = vision.previousMat;
+		cv::Mat        current  = vision.currentImage.getCvMat();
+		cv::Mat        flow;
+
+		auto measure = [&](FlowEngine::Backend backend, FlowEngine::DisPreset preset) {
+			FlowEngine engine;
+			engine.settings.backend   = backend;
+			engine.settings.disPreset = preset;
+
+			std::string name = FlowEngine::backendName(backend);
+			if (backend == FlowEngine::BACKEND_DIS) {
+				name += std::string(" ") + FlowEngine::presetName(preset);
+			}
+			Benchmark::Result run = Benchmark::run("flow " + name, 50,
+			                                       [&] { engine.calculate(previous, current, flow); });
+
+			int    half  = flow.cols / 2;
+			double left  = half > 0 ? cv::mean(flow.colRange(0, half))[1] : 0.0;
+			double right = half > 0 ? cv::mean(flow.colRange(half, flow.cols))[1] : 0.0;
+			result["flowBackends"].push_back(
+			    { { "backend", name }, { "meanMs", run.meanMs }, { "leftY", left }, { "rightY", right } });
+		};
+
+		measure(FlowEngine::BACKEND_FARNEBACK, FlowEngine::DIS_ULTRAFAST);
+		if (FlowEngine::isAvailable(FlowEngine::BACKEND_DIS)) {
+			for (int preset = 0; preset < FlowEngine::DIS_PRESET_COUNT; preset++) {
+				measure(FlowEngine::BACKEND_DIS, (FlowEngine::DisPreset)preset);
+			}
+		}
+		measure(FlowEngine::BACKEND_SPARSE, FlowEngine::DIS_ULTRAFAST);
+	}
+
+	// fused preprocessing vs the OpenCV chain it replaced: cost per frame, and how far apart the
+	// small images and the Farneback fields computed from them end up on two fresh frames
+	{
+		VisionPipeline reference, fused;
+		for (VisionPipeline *pipeline : { &reference, &fused }) {
+			pipeline->settings = vision.settings;
+			pipeline->setup(sourceWidth, sourceHeight, false);
+			pipeline->allocate();
+		}
+
+		for (int i = 0; i < 2; i++) {
+			source->update();
+			reference.processFrameReference(source->getPixels());
+			reference.calculateOpticalFlow();
+			fused.processFrame(source->getPixels());
+			fused.calculateOpticalFlow();
+		}
+
+		cv::Mat referenceImage = reference.currentImage.getCvMat();
+		cv::Mat fusedImage     = fused.currentImage.getCvMat();
+		double  maxImageDiff   = cv::norm(referenceImage, fusedImage, cv::NORM_INF);
+		double  maxFlowDiff    = cv::norm(reference.flowMat, fused.flowMat, cv::NORM_INF);
+		double  meanFlowDiff   = cv::norm(reference.flowMat, fused.flowMat, cv::NORM_L1) / (2.0 * fused.flowMat.total());
+
+		const ofPixels   &camera       = source->getPixels();
+		Benchmark::Result referenceRun = Benchmark::run("preprocess reference", 100,
+		                                                [&] { reference.processFrameReference(camera); });
+		Benchmark::Result fusedRun     = Benchmark::run("preprocess fused", 100, [&] { fused.processFrame(camera); });
+
+		result["preprocess"] = { { "referenceMs", referenceRun.meanMs },
+			                     { "fusedMs", fusedRun.meanMs },
+			                     { "referenceCopiedBytes", reference.getCopiedBytes() },
+			                     { "fusedCopiedBytes", fused.getCopiedBytes() },
+			                     { "maxImageDifference", maxImageDiff },
+			                     { "maxFlowDifference", maxFlowDiff },
+			                     { "meanFlowDifference", meanFlowDiff } };
+	}
+
+	// column order vs tiles, fused update on one thread so the counters see all of it
+	{
+		const ofPixels &camera = source->getPixels();
+		PerfCounters    counters;
+		if (!counters.isAvailable()) {
+			ofLogNotice("BenchmarkApp") << "no hardware counters (perf_event_open), timing the layouts only";
+		}
+
+		auto measure = [&](ParticleSystem::Layout layout, const std::string &name) {
+			ParticleSystem system;
+			system.setLayout(layout);
+			system.generateParticles(sourceWidth, sourceHeight, spacing);
+			system.setThreadCount(1);
+			auto step = [&] {
+				system.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+				                       vision.settings.bMirror, camera, particleSize);
+			};
+			Benchmark::Result run = Benchmark::run("particles " + name, 100, step);
+
+			counters.start();
+			for (int i = 0; i < run.iterations; i++) {
+				step();
+			}
+			PerfCounters::Values values = counters.stop();
+
+			ofJson entry = { { "meanMs", run.meanMs } };
+			for (int c = 0; c < PerfCounters::COUNTER_COUNT; c++) {
+				if (values.counts[c] >= 0) {
+					entry[std::string(PerfCounters::counterName(c)) + "PerParticle"]
+					    = (double)values.counts[c] / ((double)run.iterations * system.getParticleCount());
+				}
+			}
+			return entry;
+		};
+		result["layout"] = { { "columns", measure(ParticleSystem::LAYOUT_COLUMNS, "columns") },
+			                 { "tiles", measure(ParticleSystem::LAYOUT_TILES, "tiles") } };
+	}
+
+	// particle update vs thread count on the last flow field; the flow vectors must not change
+	{
+		ParticleSystem reference;
+		reference.generateParticles(sourceWidth, sourceHeight, spacing);
+		reference.setThreadCount(1);
+
+		int    maxThreads    = std::max(1u, std::thread::hardware_concurrency());
+		double singleMs      = 0.0;
+		bool   deterministic = true;
+		for (int threads = 1; threads <= maxThreads; threads *= 2) {
+			ParticleSystem scaled;
+			scaled.generateParticles(sourceWidth, sourceHeight, spacing);
+			scaled.setThreadCount(threads);
+
+			Benchmark::Result run = Benchmark::run("particles x" + ofToString(threads), 100, [&] {
+				scaled.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+				                       vision.settings.bMirror);
+			});
+			if (threads == 1) {
+				singleMs = run.meanMs;
+			}
+
+			// same number of steps as the run above (warm-up + iterations)
+			for (int i = 0; i < run.iterations + 1; i++) {
+				reference.updateParticles(vision.flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+				                          vision.settings.bMirror);
+			}
+			deterministic = deterministic && scaled.getLeftFlowVector() == reference.getLeftFlowVector()
+			                && scaled.getRightFlowVector() == reference.getRightFlowVector()
+			                && scaled.maxPositionDifference(reference) == 0.0f;
+			reference.clear();
+			reference.generateParticles(sourceWidth, sourceHeight, spacing);
+
+			double speedup = run.meanMs > 0 ? singleMs / run.meanMs : 0.0;
+			result["threadScaling"].push_back({ { "threads", threads }, { "meanMs", run.meanMs }, { "speedup", speedup } });
+		}
+		result["threadsDeterministic"] = deterministic;
+	}
+
+	double total = 0.0;
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		Benchmark::Result r = Benchmark::summarize(stageName(s), samples[s]);
+		total += r.meanMs;
+
+		result["stages"][stageName(s)] = { { "mean", r.meanMs }, { "p50", r.p50Ms }, { "p95", r.p95Ms },
+			                               { "p99", r.p99Ms } };
+	}
+
+	ofLogNotice("BenchmarkApp") << "spacing " << spacing << ", cvDownScale " << downScale << ": "
+	                            << particles.getParticleCount() << " particles, " << ofToString(total, 3)
+	                            << " ms/frame, " << ofToString(result["throughputFps"].get<double>(), 1) << " fps, "
+	                            << ofToString(result["allocationsPerFrame"].get<double>(), 1) << " allocs/frame";
+	return result;
+}
+
+const char *BenchmarkApp::stageName(int stage) {
+	switch (stage) {
+		case STAGE_CAPTURE:
+			return "capture";
+		case STAGE_PROCESS:
+			return "process";
+		case STAGE_FLOW:
+			return "flow";
+		case STAGE_PARTICLES:
+			return "particles";
+		case STAGE_MESH:
+			return "mesh";
+		default:
+			return "?";
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "DetectionTracker.h"
+#include "FrameSource.h"
+#include "Particles.h"
+#include "VisionPipeline.h"
+#include "ofMain.h"
+
+// Headless run of the vision pipeline (pixels -> gray/downscale -> flow -> particles and
+// colors -> mesh) over a grid of particle spacings and cvDownScale values. Reports
+// p50/p95/p99 per stage, allocations per frame and throughput, and writes everything to a
+// JSON file so builds can be compared. Each case also compares the scalar and SSE particle
+// kernels, column vs tiled particle order (with cache miss counters where perf_event_open is
+// allowed), the cost of every optical flow backend and how the particle update scales with
+// the thread count. Before the cases, checkTracker() runs DetectionTracker on scripted boxes;
+// the process exits with 1 when it fails.
+// Started with --bench, see main.cpp.
+class BenchmarkApp : public ofBaseApp {
+public:
+	struct Settings {
+		std::string         sourceSpec   = "synthetic";
+		std::string         outputPath   = "bench_results.json";
+		int                 frames       = 300;
+		int                 warmupFrames = 30;
+		std::vector<int>    spacings     = { 2, 4, 8, 16 };
+		std::vector<float>  downScales   = { 4, 8, 16 };
+		int                 threads      = 0; // particle update threads, 0 = all cores
+		FlowEngine::Backend flowBackend  = FlowEngine::BACKEND_FARNEBACK; // pipeline stages only
+	};
+
+	explicit BenchmarkApp(const Settings &settings) : settings(settings) {
+	}
+
+	void setup();
+	void update();
+
+private:
+	enum Stage
+	{
+		STAGE_CAPTURE,
+		STAGE_PROCESS,
+		STAGE_FLOW,
+		STAGE_PARTICLES,
+		STAGE_MESH,
+		STAGE_COUNT
+	};
+
+	Settings settings;
+	bool     bDone = false;
+
+	ofJson runCase(int spacing, float downScale);
+	ofJson checkTracker();
+
+	static const char *stageName(int stage);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Control ids shared by the JSON and the binary messages of the control panel (index.html).
+//   JSON    {"id": "slider_3", "param": 0..1000, "total_parameters": 24}, one control per text frame
+//   binary  a binary frame of 3 byte records, each the control id and its value as uint16 little
+//           endian; a panel batches every control that changed since its last frame into one
+// Toggles are 0x00 + index, sliders 0x10 + index. The app announces binary support with the text
+// message {"caps": ["binary"]} when it connects and whenever a panel says {"hello": ...}.
+namespace ControlProtocol {
+
+enum
+{
+	TOGGLE_BASE   = 0x00,
+	SLIDER_BASE   = 0x10,
+	CONTROL_COUNT = 0x20,
+	RECORD_SIZE   = 3
+};
+
+inline const char *capsMessage() {
+	return "{\"caps\":[\"binary\"]}";
+}
+
+inline int toggle(int index) {
+	return TOGGLE_BASE + index;
+}
+
+inline int slider(int index) {
+	return SLIDER_BASE + index;
+}
+
+// "toggle_N" / "slider_N" -> control id, -1 for anything else
+inline int parseName(const std::string &name) {
+	int base;
+	if (name.compare(0, 7, "toggle_") == 0) {
+		base = TOGGLE_BASE;
+	} else if (name.compare(0, 7, "slider_") == 0) {
+		base = SLIDER_BASE;
+	} else {
+		return -1;
+	}
+	if (name.size() < 8 || name.size() > 9) {
+		return -1;
+	}
+
+	int index = 0;
+	for (size_t i = 7; i < name.size(); i++) {
+		if (name[i] < '0' || name[i] > '9') {
+			return -1;
+		}
+		index = index * 10 + (name[i] - '0');
+	}
+	return index < SLIDER_BASE - TOGGLE_BASE ? base + index : -1;
+}
+
+// calls emit(control, value) for every record, in order, without allocating. Returns false
+// (before emitting anything) when the length is not a whole number of records or an id is out
+// of range, so a garbled frame is rejected as a whole.
+template <typename Emit>
+bool decode(const uint8_t *data, size_t size, Emit &&emit) {
+	if (size == 0 || size % RECORD_SIZE != 0) {
+		return false;
+	}
+	for (size_t i = 0; i < size; i += RECORD_SIZE) {
+		if (data[i] >= CONTROL_COUNT) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < size; i += RECORD_SIZE) {
+		emit(data[i], (uint16_t)(data[i + 1] | (data[i + 2] << 8)));
+	}
+	return true;
+}
+
+} // namespace ControlProtocol
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "ofMain.h"
+#include "yolo5ImageClassify.h"
+
+// Keeps YOLO detections alive between inference frames. Each update() associates the new
+// detections with existing tracks (greedy, best IoU first, falling back to centroid distance
+// for fast movers), and predict() extrapolates every track with a constant velocity so boxes
+// move every render frame instead of jumping when a new result lands.
+// Timestamps are seconds on any monotonic clock; nothing here touches GL or the camera.
+class DetectionTracker {
+public:
+	struct Track {
+		int         id;
+		std::string label;
+		float       confidence;
+		ofRectangle rect;      // box at lastSeen
+		ofRectangle predicted; // box extrapolated to the last predict() time
+		glm::vec2   velocity;  // box center, pixels per second
+		double      lastSeen;
+		int         hits;
+		int         misses;
+	};
+
+	struct Settings {
+		float minIoU            = 0.2f;
+		float maxCenterDistance = 0.5f;  // fallback match radius, in units of the track box diagonal
+		float velocityBlend     = 0.5f;  // weight of the newest velocity measurement
+		int   maxMisses         = 3;     // updates without a match before a track is dropped
+		float maxPredictSeconds = 0.35f; // never extrapolate further than this past lastSeen
+	};
+
+	Settings settings;
+
+	void clear() {
+		tracks.clear();
+	}
+
+	void update(const std::vector<yolo5ImageClassify::Result> &detections, double time) {
+		// candidate pairs, scored so IoU matches always win over distance-only matches
+		candidates.clear();
+		for (size_t t = 0; t < tracks.size(); t++) {
+			ofRectangle expected = extrapolate(tracks[t], time);
+			float       diagonal = glm::length(glm::vec2(expected.width, expected.height));
+
+			for (size_t d = 0; d < detections.size(); d++) {
+				if (detections[d].label != tracks[t].label) {
+					continue;
+				}
+
+				float iou = intersectionOverUnion(expected, detections[d].rect);
+				if (iou >= settings.minIoU) {
+					candidates.push_back({ (int)t, (int)d, 1.0f + iou });
+					continue;
+				}
+
+				float distance = glm::distance(center(expected), center(detections[d].rect));
+				if (diagonal > 0.0f && distance < settings.maxCenterDistance * diagonal) {
+					candidates.push_back({ (int)t, (int)d, 1.0f - distance / (settings.maxCenterDistance * diagonal) });
+				}
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(),
+		          [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+
+		trackMatched.assign(tracks.size(), false);
+		detectionMatched.assign(detections.size(), false);
+
+		for (const Candidate &c : candidates) {
+			if (trackMatched[c.track] || detectionMatched[c.detection]) {
+				continue;
+			}
+			trackMatched[c.track]         = true;
+			detectionMatched[c.detection] = true;
+			correct(tracks[c.track], detections[c.detection], time);
+		}
+
+		for (size_t t = 0; t < tracks.size(); t++) {
+			if (!trackMatched[t]) {
+				tracks[t].misses++;
+			}
+		}
+
+		tracks.erase(std::remove_if(tracks.begin(), tracks.end(),
+		                            [this](const Track &track) { return track.misses > settings.maxMisses; }),
+		             tracks.end());
+
+		for (size_t d = 0; d < detections.size(); d++) {
+			if (!detectionMatched[d] && !detections[d].label.empty()) {
+				spawn(detections[d], time);
+			}
+		}
+	}
+
+	// moves every track's predicted box to the given time
+	void predict(double time) {
+		for (Track &track : tracks) {
+			track.predicted = extrapolate(track, time);
+		}
+	}
+
+	// optional: start new tracks with the mean optical flow inside their box instead of at rest.
+	// flow is the field of the (possibly mirrored) downscaled camera image, in pixels per flow
+	// frame; framesPerSecond is the rate of those frames (the camera's, not the render loop's),
+	// 0 when unknown starts tracks at rest.
+	void setFlow(const cv::Mat *flow, float sourceWidth, float sourceHeight, bool mirrored, float framesPerSecond) {
+		flowMat      = flow;
+		flowSourceW  = sourceWidth;
+		flowSourceH  = sourceHeight;
+		flowMirrored = mirrored;
+		flowFps      = framesPerSecond;
+	}
+
+	const std::vector<Track> &getTracks() const {
+		return tracks;
+	}
+
+	static float intersectionOverUnion(const ofRectangle &a, const ofRectangle &b) {
+		float x0 = std::max(a.getLeft(), b.getLeft());
+		float y0 = std::max(a.getTop(), b.getTop());
+		float x1 = std::min(a.getRight(), b.getRight());
+		float y1 = std::min(a.getBottom(), b.getBottom());
+
+		float intersection = std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+		float unionArea    = a.getArea() + b.getArea() - intersection;
+		return unionArea > 0.0f ? intersection / unionArea : 0.0f;
+	}
+
+private:
+	struct Candidate {
+		int   track;
+		int   detection;
+		float score;
+	};
+
+	std::vector<Track>     tracks;
+	std::vector<Candidate> candidates;
+	std::vector<bool>      trackMatched;
+	std::vector<bool>      detectionMatched;
+	int                    nextId = 0;
+
+	const cv::Mat *flowMat      = nullptr;
+	float          flowSourceW  = 0.0f;
+	float          flowSourceH  = 0.0f;
+	bool           flowMirrored = false;
+	float          flowFps      = 60.0f;
+
+	static glm::vec2 center(const ofRectangle &r) {
+		return glm::vec2(r.x + r.width * 0.5f, r.y + r.height * 0.5f);
+	}
+
+	ofRectangle extrapolate(const Track &track, double time) const {
+		float       dt = ofClamp(time - track.lastSeen, 0.0, settings.maxPredictSeconds);
+		ofRectangle r  = track.rect;
+		r.x += track.velocity.x * dt;
+		r.y += track.velocity.y * dt;
+		return r;
+	}
+
+	void correct(Track &track, const yolo5ImageClassify::Result &detection, double time) {
+		float dt = time - track.lastSeen;
+		if (dt > 0.0f) {
+			glm::vec2 measured = (center(detection.rect) - center(track.rect)) / dt;
+			track.velocity     = glm::mix(track.velocity, measured, track.hits > 1 ? settings.velocityBlend : 1.0f);
+		}
+
+		track.rect       = detection.rect;
+		track.predicted  = detection.rect;
+		track.confidence = detection.confidence;
+		track.lastSeen   = time;
+		track.hits++;
+		track.misses = 0;
+	}
+
+	void spawn(const yolo5ImageClassify::Result &detection, double time) {
+		Track track;
+		track.id         = nextId++;
+		track.label      = detection.label;
+		track.confidence = detection.confidence;
+		track.rect       = detection.rect;
+		track.predicted  = detection.rect;
+		track.velocity   = flowVelocity(detection.rect);
+		track.lastSeen   = time;
+		track.hits       = 1;
+		track.misses     = 0;
+		tracks.push_back(track);
+	}
+
+	glm::vec2 flowVelocity(const ofRectangle &rect) const {
+		if (flowMat == nullptr || flowMat->empty() || flowSourceW <= 0.0f || flowSourceH <= 0.0f || flowFps <= 0.0f) {
+			return glm::vec2(0, 0);
+		}
+
+		float toCellX = flowMat->cols / flowSourceW;
+		float toCellY = flowMat->rows / flowSourceH;
+
+		float left  = flowMirrored ? flowSourceW - rect.getRight() : rect.getLeft();
+		int   x0    = ofClamp(left * toCellX, 0, flowMat->cols - 1);
+		int   x1    = ofClamp((left + rect.width) * toCellX, 0, flowMat->cols - 1);
+		int   y0    = ofClamp(rect.getTop() * toCellY, 0, flowMat->rows - 1);
+		int   y1    = ofClamp(rect.getBottom() * toCellY, 0, flowMat->rows - 1);
+		int   count = 0;
+
+		glm::vec2 sum(0, 0);
+		for (int y = y0; y <= y1; y++) {
+			const cv::Point2f *row = flowMat->ptr<cv::Point2f>(y);
+			for (int x = x0; x <= x1; x++) {
+				sum += glm::vec2(row[x].x, row[x].y);
+				count++;
+			}
+		}
+		if (count == 0) {
+			return glm::vec2(0, 0);
+		}
+
+		// flow cells -> source pixels, frames -> seconds, and back out of the mirror
+		glm::vec2 velocity = sum / (float)count;
+		velocity.x *= (flowMirrored ? -1.0f : 1.0f) * flowFps / toCellX;
+		velocity.y *= flowFps / toCellY;
+		return velocity;
+	}
+};
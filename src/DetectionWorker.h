@@ -0,0 +1,290 @@
+#pragma once
+
+#include "Profiler.h"
+#include "TripleBuffer.h"
+#include "ofMain.h"
+#include "yolo5ImageClassify.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Runs yolo5ImageClassify on its own thread so net.forward() never stalls the render loop.
+// The render thread submit()s camera frames, the worker always picks the newest one (older
+// unprocessed frames are dropped, never queued) and publishes its results through a
+// lock-free TripleBuffer that update()/getResults() read without blocking.
+class DetectionWorker {
+public:
+	struct Stats {
+		float    inferenceMs     = 0.0f; // last completed detection
+		float    avgInferenceMs  = 0.0f; // smoothed
+		uint64_t submitted       = 0;
+		uint64_t dropped         = 0; // frames replaced before the worker could take them
+		uint64_t completed       = 0;
+		float    resultAgeMs     = 0.0f; // capture time of the shown result -> now
+		uint64_t resultAgeFrames = 0;
+		int      inputSize       = 0;
+		int      detectInterval  = 0;
+		size_t   copiedBytes     = 0; // per submit(): the camera frame copied into the slot
+	};
+
+	~DetectionWorker() {
+		stop();
+	}
+
+	void setup(const DetectorConfig &config) {
+		classify.setup(config);
+		inputSize      = config.inputSize;
+		detectInterval = config.detectInterval;
+		inputSizes     = config.availableSizes();
+		lastGoodSize   = config.inputSize;
+	}
+
+	void start() {
+		if (running) {
+			return;
+		}
+		running = true;
+		thread  = std::thread(&DetectionWorker::run, this);
+	}
+
+	void stop() {
+		running = false;
+		wake.notify_all();
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// render thread ----------------------------------------------------------------------
+	void submit(const ofPixels &pixels, uint64_t frameNum) {
+		Frame &slot = frames.getWriteBuffer();
+		slot.pixels        = pixels; // same size every frame, so the slot allocation is reused
+		slot.frameNum      = frameNum;
+		slot.captureMicros = ofGetElapsedTimeMicros();
+		copiedBytes        = pixels.getTotalBytes();
+
+		if (frames.publish()) {
+			dropped++;
+		}
+		submitted++;
+		wake.notify_one();
+	}
+
+	// camera frames between two submissions, raised by the adaptive mode when inference is too slow
+	int getDetectInterval() const {
+		return detectInterval;
+	}
+
+	// applied by the worker before its next inference
+	void requestInputSize(int size) {
+		pendingInputSize = size;
+	}
+
+	// input sizes the configured models can run, ascending; fixed after setup()
+	const std::vector<int> &getInputSizes() const {
+		return inputSizes;
+	}
+
+	// swaps in the latest finished detection, returns true if it changed
+	bool update() {
+		return detections.update();
+	}
+
+	const vector<yolo5ImageClassify::Result> &getResults() const {
+		return detections.read().results;
+	}
+
+	// capture time of the frame the current results were computed from, in seconds
+	double getResultTime() const {
+		return detections.read().captureMicros / 1000000.0;
+	}
+
+	// benchmarks preprocessing and decoding on the next frame and its network output, runs on the worker thread
+	void requestBenchmark() {
+		benchmarkRequested = true;
+	}
+
+	Stats getStats() const {
+		Stats s;
+		s.inferenceMs    = inferenceMs;
+		s.avgInferenceMs = avgInferenceMs;
+		s.submitted      = submitted;
+		s.dropped        = dropped;
+		s.completed      = completed;
+		s.inputSize      = inputSize;
+		s.detectInterval = detectInterval;
+		s.copiedBytes    = copiedBytes;
+
+		const Detections &latest = detections.read();
+		if (latest.captureMicros > 0) {
+			s.resultAgeMs     = (ofGetElapsedTimeMicros() - latest.captureMicros) / 1000.0f;
+			s.resultAgeFrames = ofGetFrameNum() - latest.frameNum;
+		}
+		return s;
+	}
+
+private:
+	struct Frame {
+		ofPixels pixels;
+		uint64_t frameNum      = 0;
+		uint64_t captureMicros = 0;
+	};
+
+	struct Detections {
+		vector<yolo5ImageClassify::Result> results;
+		uint64_t                           frameNum      = 0;
+		uint64_t                           captureMicros = 0;
+	};
+
+	yolo5ImageClassify classify;
+
+	TripleBuffer<Frame>      frames;     // render -> worker
+	TripleBuffer<Detections> detections; // worker -> render
+
+	std::thread             thread;
+	std::atomic<bool>       running { false };
+	std::mutex              wakeMutex;
+	std::condition_variable wake;
+
+	std::atomic<float>    inferenceMs { 0.0f };
+	std::atomic<float>    avgInferenceMs { 0.0f };
+	std::atomic<uint64_t> submitted { 0 };
+	std::atomic<uint64_t> dropped { 0 };
+	std::atomic<uint64_t> completed { 0 };
+	std::atomic<size_t>   copiedBytes { 0 };
+	std::atomic<bool>     benchmarkRequested { false };
+
+	std::atomic<int> inputSize { 640 };
+	std::atomic<int> detectInterval { 3 };
+	std::atomic<int> pendingInputSize { 0 };
+	int              overBudgetRuns  = 0;
+	int              underBudgetRuns = 0;
+	int              lastGoodSize    = 0; // last input size a detection completed at
+	int              failedSize      = 0; // logged once until a detection succeeds again
+
+	std::vector<int> inputSizes;
+
+	void run() {
+		while (running) {
+			{
+				// the timeout only guards against a missed notify, publication itself is lock-free
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return frames.hasPending() || !running; });
+			}
+
+			if (!running || !frames.update()) {
+				continue;
+			}
+
+			Frame &frame = frames.getReadBuffer();
+			if (!frame.pixels.isAllocated()) {
+				continue;
+			}
+
+			auto        t0  = std::chrono::steady_clock::now();
+			Detections &out       = detections.getWriteBuffer();
+			int         requested = pendingInputSize.exchange(0);
+			int         attempted = requested > 0 ? requested : classify.getInputSize();
+			try {
+				if (attempted != classify.getInputSize()) {
+					applyInputSize(attempted);
+				}
+
+				classify.setRecordOutput(benchmarkRequested);
+				Profiler::Scope scope(Profiler::STAGE_DETECTION);
+				classify.classifyFrame(frame.pixels, out.results);
+			} catch (const cv::Exception &e) {
+				recover(attempted, e);
+				continue;
+			}
+			lastGoodSize      = classify.getInputSize();
+			failedSize        = 0;
+			out.frameNum      = frame.frameNum;
+			out.captureMicros = frame.captureMicros;
+			float ms          = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+			detections.publish();
+
+			inferenceMs    = ms;
+			avgInferenceMs = avgInferenceMs == 0.0f ? ms : ofLerp(avgInferenceMs, ms, 0.1f);
+			completed++;
+
+			adapt();
+
+			if (benchmarkRequested) {
+				classify.benchmarkPreprocess(frame.pixels);
+				classify.benchmarkDecoder();
+				benchmarkRequested = false;
+			}
+		}
+	}
+
+	// a model that cannot run at the requested size (fixed input shape, missing file) throws from
+	// the load or from net.forward(); go back to the last size that worked instead of taking the
+	// worker thread down
+	void recover(int size, const cv::Exception &e) {
+		if (size != failedSize) {
+			ofLogError("DetectionWorker") << "Detection at input size " << size << " failed: " << e.what();
+			failedSize = size;
+		}
+		if (lastGoodSize > 0 && lastGoodSize != classify.getInputSize()) {
+			try {
+				applyInputSize(lastGoodSize);
+			} catch (const cv::Exception &reload) {
+				ofLogError("DetectionWorker") << "Reverting to input size " << lastGoodSize
+				                              << " failed: " << reload.what();
+			}
+		}
+	}
+
+	void applyInputSize(int size) {
+		classify.setInputSize(size);
+		inputSize      = size;
+		avgInferenceMs = 0.0f; // old timings say nothing about the new size
+	}
+
+	// over budget: shrink the input first (cheaper per run, applied before the next inference), then
+	// stretch the cadence. plenty of headroom: undo in reverse order. the band in between keeps it from oscillating.
+	void adapt() {
+		const DetectorConfig &config = classify.getConfig();
+		if (!config.adaptive) {
+			return;
+		}
+
+		const int patience = 10;
+		float     avg      = avgInferenceMs;
+
+		if (avg > config.budgetMs) {
+			overBudgetRuns++;
+			underBudgetRuns = 0;
+		} else if (avg < config.budgetMs * 0.5f) {
+			underBudgetRuns++;
+			overBudgetRuns = 0;
+		} else {
+			overBudgetRuns  = 0;
+			underBudgetRuns = 0;
+		}
+
+		const auto &sizes   = inputSizes;
+		auto        current = std::find(sizes.begin(), sizes.end(), classify.getInputSize());
+
+		if (overBudgetRuns >= patience) {
+			overBudgetRuns = 0;
+			if (current != sizes.begin() && current != sizes.end() && *(current - 1) >= config.minInputSize) {
+				pendingInputSize = *(current - 1);
+			} else if (detectInterval < config.maxInterval) {
+				detectInterval++;
+			}
+		} else if (underBudgetRuns >= patience) {
+			underBudgetRuns = 0;
+			if (detectInterval > config.detectInterval) {
+				detectInterval--;
+			} else if (current != sizes.end() && current + 1 != sizes.end() && *(current + 1) <= config.inputSize) {
+				pendingInputSize = *(current + 1);
+			}
+		}
+	}
+};
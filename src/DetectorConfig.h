@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Everything the detector needs to know about the model and how hard to run it.
+// Loaded from bin/data/detector.json when present, see load().
+struct DetectorConfig {
+	enum class Device
+	{
+		Cpu,
+		OpenCL,
+		Cuda
+	};
+
+	std::string modelFile   = "yolov5n.onnx";
+	std::string classesFile = "classes.txt";
+
+	// optional per-input-size model files, for networks exported with a fixed input shape
+	std::map<int, std::string> modelFiles;
+
+	Device device    = Device::Cpu;
+	int    inputSize = 640; // square network input, one of supportedSizes()
+
+	// submit every n-th camera frame to the detector
+	int detectInterval = 3;
+
+	// adaptive mode trades input size and then cadence for a stable inference time
+	bool  adaptive     = false;
+	float budgetMs     = 40.0f;
+	int   minInputSize = 320;
+	int   maxInterval  = 12;
+
+	static const std::vector<int> &supportedSizes() {
+		static const std::vector<int> sizes = { 320, 416, 512, 640 };
+		return sizes;
+	}
+
+	// YOLOv5 predicts 3 anchors per cell on the stride 8, 16 and 32 grids
+	static int outputRows(int inputSize) {
+		int rows = 0;
+		for (int stride : { 8, 16, 32 }) {
+			rows += 3 * (inputSize / stride) * (inputSize / stride);
+		}
+		return rows;
+	}
+
+	// the supported sizes the configured models can run: inputSize with the default model and every
+	// size with its own file. list a model exported with dynamic input axes under "models" for each
+	// size it should be switched to
+	std::vector<int> availableSizes() const {
+		std::vector<int> sizes;
+		for (int size : supportedSizes()) {
+			if (size == inputSize || modelFiles.count(size)) {
+				sizes.push_back(size);
+			}
+		}
+		return sizes;
+	}
+
+	std::string modelFor(int size) const {
+		auto it = modelFiles.find(size);
+		return it != modelFiles.end() ? it->second : modelFile;
+	}
+
+	static std::string deviceName(Device d) {
+		switch (d) {
+			case Device::Cuda:
+				return "cuda";
+			case Device::OpenCL:
+				return "opencl";
+			default:
+				return "cpu";
+		}
+	}
+
+	static DetectorConfig load(const std::string &path) {
+		DetectorConfig config;
+
+		if (!ofFile::doesFileExist(path)) {
+			ofLogNotice("DetectorConfig") << path << " not found, using defaults";
+			return config;
+		}
+
+		try {
+			ofJson json = ofLoadJson(path);
+
+			config.modelFile      = json.value("model", config.modelFile);
+			config.classesFile    = json.value("classes", config.classesFile);
+			config.inputSize      = json.value("inputSize", config.inputSize);
+			config.detectInterval = std::max(1, json.value("detectInterval", config.detectInterval));
+			config.adaptive       = json.value("adaptive", config.adaptive);
+			config.budgetMs       = json.value("budgetMs", config.budgetMs);
+			config.minInputSize   = json.value("minInputSize", config.minInputSize);
+			config.maxInterval    = json.value("maxInterval", config.maxInterval);
+
+			std::string device = json.value("device", deviceName(config.device));
+			if (device == "cuda") {
+				config.device = Device::Cuda;
+			} else if (device == "opencl") {
+				config.device = Device::OpenCL;
+			} else {
+				config.device = Device::Cpu;
+			}
+
+			if (json.contains("models")) {
+				for (auto &entry : json["models"].items()) {
+					config.modelFiles[ofToInt(entry.key())] = entry.value().get<std::string>();
+				}
+			}
+		} catch (std::exception &e) {
+			ofLogError("DetectorConfig") << "Failed to parse " << path << ": " << e.what();
+		}
+
+		const auto &sizes = supportedSizes();
+		if (std::find(sizes.begin(), sizes.end(), config.inputSize) == sizes.end()) {
+			ofLogWarning("DetectorConfig") << "Unsupported input size " << config.inputSize << ", using 640";
+			config.inputSize = 640;
+		}
+		return config;
+	}
+};
@@ -0,0 +1,131 @@
+#include "FlowEngine.h"
+#include "Profiler.h"
+
+void FlowEngine::calculate(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow) {
+	uint64_t start = Profiler::now();
+
+	activeBackend = isAvailable(settings.backend) ? settings.backend : BACKEND_FARNEBACK;
+	switch (activeBackend) {
+		case BACKEND_DIS:
+			calculateDis(previous, current, flow);
+			break;
+		case BACKEND_SPARSE:
+			calculateSparse(previous, current, flow);
+			break;
+		default:
+			calculateFarneback(previous, current, flow);
+			break;
+	}
+
+	lastMs         = (Profiler::now() - start) / 1000.0f;
+	float &average = averageMs[activeBackend];
+	average        = average > 0.0f ? ofLerp(average, lastMs, 0.05f) : lastMs;
+}
+
+bool FlowEngine::isAvailable(Backend backend) {
+#ifndef FLOW_ENGINE_DIS
+	if (backend == BACKEND_DIS) {
+		return false;
+	}
+#endif
+	return backend >= 0 && backend < BACKEND_COUNT;
+}
+
+bool FlowEngine::parseBackend(const std::string &name, Backend &backend) {
+	for (int b = 0; b < BACKEND_COUNT; b++) {
+		if (name == backendName(b)) {
+			backend = (Backend)b;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *FlowEngine::backendName(int backend) {
+	switch (backend) {
+		case BACKEND_FARNEBACK:
+			return "farneback";
+		case BACKEND_DIS:
+			return "dis";
+		case BACKEND_SPARSE:
+			return "sparse";
+		default:
+			return "?";
+	}
+}
+
+const char *FlowEngine::presetName(int preset) {
+	switch (preset) {
+		case DIS_ULTRAFAST:
+			return "ultrafast";
+		case DIS_FAST:
+			return "fast";
+		case DIS_MEDIUM:
+			return "medium";
+		default:
+			return "?";
+	}
+}
+
+void FlowEngine::calculateFarneback(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow) {
+	cv::calcOpticalFlowFarneback(previous, current, flow, settings.pyrScale, settings.levels, settings.winSize,
+	                             settings.iterations, settings.polyN, settings.polySigma,
+	                             settings.gaussian ? cv::OPTFLOW_FARNEBACK_GAUSSIAN : 0);
+}
+
+void FlowEngine::calculateDis(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow) {
+#ifdef FLOW_ENGINE_DIS
+	if (!dis || disPreset != settings.disPreset) {
+		static const int presets[DIS_PRESET_COUNT] = { cv::DISOpticalFlow::PRESET_ULTRAFAST,
+			                                           cv::DISOpticalFlow::PRESET_FAST,
+			                                           cv::DISOpticalFlow::PRESET_MEDIUM };
+		disPreset = ofClamp(settings.disPreset, 0, DIS_PRESET_COUNT - 1);
+		dis       = cv::DISOpticalFlow::create(presets[disPreset]);
+	}
+	dis->calc(previous, current, flow);
+#else
+	calculateFarneback(previous, current, flow);
+#endif
+}
+
+void FlowEngine::calculateSparse(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow) {
+	int   step = std::max(1, settings.gridStep);
+	float band = ofClamp(settings.bandWidth, 0.0f, 0.5f);
+
+	// one point in the middle of every grid block inside the left or the right band
+	if (pointsSize != current.size() || pointsStep != step || pointsBand != band) {
+		pointsSize = current.size();
+		pointsStep = step;
+		pointsBand = band;
+
+		float left  = current.cols * band;
+		float right = current.cols * (1.0f - band);
+		points.clear();
+		for (int y = step / 2; y < current.rows; y += step) {
+			for (int x = step / 2; x < current.cols; x += step) {
+				if (x < left || x >= right) {
+					points.emplace_back(x, y);
+				}
+			}
+		}
+	}
+
+	flow.create(current.size(), CV_32FC2);
+	flow.setTo(cv::Scalar::all(0));
+	if (points.empty()) {
+		return;
+	}
+
+	int window = std::max(3, settings.lkWinSize | 1);
+	cv::calcOpticalFlowPyrLK(previous, current, points, tracked, status, error, cv::Size(window, window),
+	                         std::max(0, settings.lkLevels));
+
+	for (size_t i = 0; i < points.size(); i++) {
+		if (!status[i]) {
+			continue;
+		}
+		cv::Point2f motion = tracked[i] - points[i];
+		cv::Rect    block((int)points[i].x - step / 2, (int)points[i].y - step / 2, step, step);
+		flow(block & cv::Rect(0, 0, flow.cols, flow.rows)).setTo(cv::Scalar(motion.x, motion.y));
+	}
+}
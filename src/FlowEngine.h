@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOpenCv.h"
+
+#if CV_VERSION_MAJOR >= 4
+#define FLOW_ENGINE_DIS
+#endif
+
+// Dense optical flow between two gray frames, with interchangeable backends:
+//   farneback  cv::calcOpticalFlowFarneback, the original; every parameter is tunable
+//   dis        cv::DISOpticalFlow with the ultrafast / fast / medium presets (OpenCV 4)
+//   sparse     pyramidal Lucas-Kanade on a coarse grid of points, only in a band on the left
+//              and the right edge; each point's flow fills its grid block, the rest is zero
+// The output is always a CV_32FC2 field the size of the input, so particles, tracker and
+// paddles do not depend on the backend. Every call is timed and averaged per backend, so the
+// cost of a switch can be read off getAverageMs() at runtime.
+class FlowEngine {
+public:
+	enum Backend
+	{
+		BACKEND_FARNEBACK,
+		BACKEND_DIS,
+		BACKEND_SPARSE,
+		BACKEND_COUNT
+	};
+
+	enum DisPreset
+	{
+		DIS_ULTRAFAST,
+		DIS_FAST,
+		DIS_MEDIUM,
+		DIS_PRESET_COUNT
+	};
+
+	struct Settings {
+		Backend backend = BACKEND_FARNEBACK;
+
+		// farneback, the defaults are the values the app always used
+		double pyrScale   = 0.5;
+		int    levels     = 4;
+		int    winSize    = 4;
+		int    iterations = 2;
+		int    polyN      = 4;
+		double polySigma  = 1.2;
+		bool   gaussian   = true;
+
+		DisPreset disPreset = DIS_ULTRAFAST;
+
+		// sparse grid
+		int   gridStep  = 4;    // pixels of the downscaled frame between points
+		int   lkWinSize = 9;
+		int   lkLevels  = 2;
+		float bandWidth = 0.25f; // fraction of the width tracked on each side (the paddles), 0.5 covers the frame
+	};
+
+	Settings settings;
+
+	// flow from previous to current (same size, CV_8UC1) into flow
+	void calculate(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow);
+
+	// backend that ran last, differs from settings.backend when it is not available
+	Backend getActiveBackend() const {
+		return activeBackend;
+	}
+
+	float getLastMs() const {
+		return lastMs;
+	}
+
+	// running average, 0 until the backend has run
+	float getAverageMs(Backend backend) const {
+		return averageMs[backend];
+	}
+
+	static bool isAvailable(Backend backend);
+
+	// backendName() -> backend, false for unknown names
+	static bool parseBackend(const std::string &name, Backend &backend);
+
+	static const char *backendName(int backend);
+	static const char *presetName(int preset);
+
+private:
+	Backend activeBackend = BACKEND_FARNEBACK;
+	float   lastMs        = 0.0f;
+	float   averageMs[BACKEND_COUNT] {};
+
+#ifdef FLOW_ENGINE_DIS
+	cv::Ptr<cv::DISOpticalFlow> dis;
+	int                         disPreset = -1; // preset dis was created with
+#endif
+
+	std::vector<cv::Point2f> points;
+	std::vector<cv::Point2f> tracked;
+	std::vector<uchar>       status;
+	std::vector<float>       error;
+	cv::Size                 pointsSize;
+	int                      pointsStep = 0;
+	float                    pointsBand = 0.0f;
+
+	void calculateFarneback(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow);
+	void calculateDis(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow);
+	void calculateSparse(const cv::Mat &previous, const cv::Mat &current, cv::Mat &flow);
+};
@@ -0,0 +1,199 @@
+#include "FrameSource.h"
+
+std::unique_ptr<FrameSource> FrameSource::create(const std::string &spec) {
+	if (spec.empty() || spec == "camera") {
+		return std::make_unique<CameraFrameSource>();
+	}
+	if (spec == "synthetic") {
+		return std::make_unique<SyntheticFrameSource>();
+	}
+	return std::make_unique<VideoFrameSource>(spec);
+}
+
+bool FrameSource::frameDue() {
+	if (bFreeRun) {
+		return true;
+	}
+
+	double now = ofGetElapsedTimef();
+	if (now < nextFrameTime) {
+		return false;
+	}
+	// skip ahead instead of bursting frames after a hitch
+	nextFrameTime = std::max(nextFrameTime + 1.0 / frameRate, now);
+	return true;
+}
+
+//-----------------------------------------------------------------------------------------------------------
+bool CameraFrameSource::setup(int width, int height) {
+	cam.setDesiredFrameRate(frameRate);
+	return cam.setup(width, height);
+}
+
+void CameraFrameSource::update() {
+	cam.update();
+	bFrameNew = cam.isFrameNew();
+	if (bFrameNew) {
+		frameCount++;
+	}
+}
+
+void CameraFrameSource::close() {
+	cam.close();
+}
+
+//-----------------------------------------------------------------------------------------------------------
+bool VideoFrameSource::setup(int width, int height) {
+	ofDirectory dir(path);
+
+	if (dir.isDirectory()) {
+		dir.allowExt("png");
+		dir.allowExt("jpg");
+		dir.listDir();
+		dir.sort();
+
+		size_t count = std::min(dir.size(), maxSequenceFrames);
+		sequence.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			ofLoadImage(sequence[i], dir.getPath(i));
+			if (sequence[i].getWidth() != width || sequence[i].getHeight() != height) {
+				sequence[i].resize(width, height);
+			}
+			sequence[i].setImageType(OF_IMAGE_COLOR);
+		}
+
+		bSequence = true;
+		ofLogNotice("FrameSource") << "Loaded " << count << " frames from " << path;
+		return count > 0;
+	}
+
+	if (!player.load(path)) {
+		ofLogError("FrameSource") << "Could not open " << path;
+		return false;
+	}
+
+	player.setLoopState(OF_LOOP_NORMAL);
+	player.play();
+	if (bFreeRun) {
+		// stepped manually, one decoded frame per update()
+		player.setPaused(true);
+	}
+	return true;
+}
+
+void VideoFrameSource::update() {
+	if (bSequence) {
+		bFrameNew = !sequence.empty() && frameDue();
+		if (bFrameNew) {
+			sequenceIndex = frameCount % sequence.size();
+			frameCount++;
+		}
+		return;
+	}
+
+	if (bFreeRun) {
+		player.nextFrame();
+	}
+	player.update();
+
+	bFrameNew = player.isFrameNew();
+	if (bFrameNew) {
+		frameCount++;
+	}
+}
+
+void VideoFrameSource::close() {
+	player.close();
+	sequence.clear();
+}
+
+const ofPixels &VideoFrameSource::getPixels() const {
+	if (bSequence) {
+		static const ofPixels empty;
+		return sequence.empty() ? empty : sequence[sequenceIndex];
+	}
+	return player.getPixels();
+}
+
+int VideoFrameSource::getWidth() const {
+	return bSequence ? FrameSource::getWidth() : player.getWidth();
+}
+
+int VideoFrameSource::getHeight() const {
+	return bSequence ? FrameSource::getHeight() : player.getHeight();
+}
+
+//-----------------------------------------------------------------------------------------------------------
+bool SyntheticFrameSource::setup(int width, int height) {
+	pixels.allocate(width, height, OF_PIXELS_RGB);
+
+	// the blob layout only depends on the seed, so every run sees the same motion
+	std::mt19937                          rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	blobs.resize(6);
+	for (auto &blob : blobs) {
+		blob.center    = glm::vec2(unit(rng) * width, unit(rng) * height);
+		blob.amplitude = glm::vec2(unit(rng) * width * 0.25f, unit(rng) * height * 0.4f);
+		blob.phase     = glm::vec2(unit(rng), unit(rng)) * TWO_PI;
+		blob.speed     = 0.5f + unit(rng) * 2.5f;
+		blob.radius    = height * (0.05f + unit(rng) * 0.1f);
+		blob.color     = ofColor::fromHsb(unit(rng) * 255, 200, 255);
+	}
+
+	render();
+	return true;
+}
+
+void SyntheticFrameSource::update() {
+	bFrameNew = frameDue();
+	if (bFrameNew) {
+		frameCount++;
+		render();
+	}
+}
+
+void SyntheticFrameSource::render() {
+	const int      w    = pixels.getWidth();
+	const int      h    = pixels.getHeight();
+	unsigned char *data = pixels.getData();
+
+	// time is derived from the frame index, not the clock, so free-running stays deterministic
+	float t    = frameCount / 60.0f;
+	noiseState = seed ^ (uint32_t)(frameCount * 2654435761u);
+	if (noiseState == 0) {
+		noiseState = 1;
+	}
+
+	for (int y = 0; y < h; y++) {
+		unsigned char *row  = data + (size_t)y * w * 3;
+		unsigned char  base = 20 + (y * 40) / h;
+		for (int x = 0; x < w * 3; x++) {
+			row[x] = base + (nextNoise() & 15);
+		}
+	}
+
+	for (const auto &blob : blobs) {
+		glm::vec2 c = blob.center + blob.amplitude * glm::vec2(sin(t * blob.speed + blob.phase.x),
+		                                                       sin(t * blob.speed * 0.7f + blob.phase.y));
+
+		int   x0 = ofClamp(c.x - blob.radius, 0, w - 1);
+		int   x1 = ofClamp(c.x + blob.radius, 0, w - 1);
+		int   y0 = ofClamp(c.y - blob.radius, 0, h - 1);
+		int   y1 = ofClamp(c.y + blob.radius, 0, h - 1);
+		float r2 = blob.radius * blob.radius;
+
+		for (int y = y0; y <= y1; y++) {
+			unsigned char *row = data + (size_t)y * w * 3;
+			for (int x = x0; x <= x1; x++) {
+				float dx = x - c.x;
+				float dy = y - c.y;
+				if (dx * dx + dy * dy <= r2) {
+					row[x * 3 + 0] = blob.color.r;
+					row[x * 3 + 1] = blob.color.g;
+					row[x * 3 + 2] = blob.color.b;
+				}
+			}
+		}
+	}
+}
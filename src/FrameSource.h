@@ -0,0 +1,164 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Where camera frames come from. ofApp only talks to this interface, so the flow -> particles
+// -> paddle pipeline can be driven by a webcam, a recorded video / image sequence or a
+// deterministic synthetic generator. Non-camera sources can free-run: every update() then
+// produces a new frame regardless of wall-clock time, for throughput measurements.
+class FrameSource {
+public:
+	virtual ~FrameSource() {
+	}
+
+	virtual bool setup(int width, int height) = 0;
+	virtual void update()                     = 0;
+	virtual void close() {
+	}
+
+	virtual const ofPixels &getPixels() const = 0;
+
+	virtual std::string getName() const = 0;
+
+	bool isFrameNew() const {
+		return bFrameNew;
+	}
+
+	virtual int getWidth() const {
+		return getPixels().getWidth();
+	}
+
+	virtual int getHeight() const {
+		return getPixels().getHeight();
+	}
+
+	void setFreeRun(bool freeRun) {
+		bFreeRun = freeRun;
+	}
+
+	bool isFreeRun() const {
+		return bFreeRun;
+	}
+
+	void setFrameRate(float fps) {
+		frameRate = fps;
+	}
+
+	uint64_t getFrameCount() const {
+		return frameCount;
+	}
+
+	// "camera" (default), "synthetic", an image directory or a video file
+	static std::unique_ptr<FrameSource> create(const std::string &spec);
+
+protected:
+	bool     bFrameNew     = false;
+	bool     bFreeRun      = false;
+	float    frameRate     = 60.0f;
+	double   nextFrameTime = 0.0;
+	uint64_t frameCount    = 0;
+
+	// pacing for sources that are not driven by hardware
+	bool frameDue();
+};
+
+//-----------------------------------------------------------------------------------------------------------
+class CameraFrameSource : public FrameSource {
+public:
+	bool setup(int width, int height) override;
+	void update() override;
+	void close() override;
+
+	const ofPixels &getPixels() const override {
+		return cam.getPixels();
+	}
+
+	int getWidth() const override {
+		return cam.getWidth();
+	}
+
+	int getHeight() const override {
+		return cam.getHeight();
+	}
+
+	std::string getName() const override {
+		return "camera";
+	}
+
+private:
+	ofVideoGrabber cam;
+};
+
+//-----------------------------------------------------------------------------------------------------------
+class VideoFrameSource : public FrameSource {
+public:
+	explicit VideoFrameSource(const std::string &path) : path(path) {
+	}
+
+	bool setup(int width, int height) override;
+	void update() override;
+	void close() override;
+
+	const ofPixels &getPixels() const override;
+
+	int getWidth() const override;
+	int getHeight() const override;
+
+	std::string getName() const override {
+		return "video " + path;
+	}
+
+private:
+	std::string path;
+
+	// a video file plays through ofVideoPlayer, a directory is an image sequence kept in memory
+	ofVideoPlayer         player;
+	std::vector<ofPixels> sequence;
+	size_t                sequenceIndex = 0;
+	bool                  bSequence     = false;
+
+	const size_t maxSequenceFrames = 600;
+};
+
+//-----------------------------------------------------------------------------------------------------------
+class SyntheticFrameSource : public FrameSource {
+public:
+	explicit SyntheticFrameSource(uint32_t seed = 42) : seed(seed) {
+	}
+
+	bool setup(int width, int height) override;
+	void update() override;
+
+	const ofPixels &getPixels() const override {
+		return pixels;
+	}
+
+	std::string getName() const override {
+		return "synthetic";
+	}
+
+private:
+	struct Blob {
+		glm::vec2 center;
+		glm::vec2 amplitude;
+		glm::vec2 phase;
+		float     speed;
+		float     radius;
+		ofColor   color;
+	};
+
+	uint32_t          seed;
+	uint32_t          noiseState = 0;
+	ofPixels          pixels;
+	std::vector<Blob> blobs;
+
+	// xorshift, deterministic and much cheaper than ofRandom per pixel
+	uint32_t nextNoise() {
+		noiseState ^= noiseState << 13;
+		noiseState ^= noiseState >> 17;
+		noiseState ^= noiseState << 5;
+		return noiseState;
+	}
+
+	void render();
+};
@@ -0,0 +1,244 @@
+#include "GpuParticleSystem.h"
+
+bool GpuParticleSystem::isSupported() {
+	if (supported < 0) {
+		GLint vertexTextureUnits = 0;
+		glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertexTextureUnits);
+
+		supported = GLEW_ARB_texture_float && GLEW_ARB_texture_rg && GLEW_ARB_framebuffer_object
+		            && vertexTextureUnits >= 2;
+		if (!supported) {
+			ofLogError("GpuParticleSystem") << "needs ARB_texture_float, ARB_texture_rg, ARB_framebuffer_object and "
+			                                << "2 vertex texture units (has " << vertexTextureUnits << ")";
+			return false;
+		}
+
+		// shaders that do not compile make the system unsupported as well, known before it is switched on
+		bool loaded = simulateShader.load("shaders/passthrough.vert", "shaders/particlesSimulate.frag");
+		loaded      = reduceShader.load("shaders/passthrough.vert", "shaders/particlesReduce.frag") && loaded;
+		loaded      = drawShader.load("shaders/particlesGpu.vert", "shaders/particles.frag") && loaded;
+		if (!loaded) {
+			ofLogError("GpuParticleSystem") << "shaders failed to load";
+			supported = 0;
+		}
+	}
+	return supported;
+}
+
+void GpuParticleSystem::generateParticles(int width, int height, float spacing) {
+	gridWidth     = width / spacing;
+	gridHeight    = height / spacing;
+	this->spacing = spacing;
+	bDirty        = true;
+}
+
+bool GpuParticleSystem::allocate() {
+	if (!isSupported()) {
+		return false;
+	}
+
+	particleCount = gridWidth * gridHeight;
+	stateWidth    = std::max(1, std::min((int)particleCount, MAX_STATE_WIDTH));
+	stateHeight   = std::max(1, (int)((particleCount + stateWidth - 1) / stateWidth));
+
+	ofFbo::Settings settings;
+	settings.width              = stateWidth;
+	settings.height             = stateHeight;
+	settings.internalformat     = GL_RGBA32F;
+	settings.textureTarget      = GL_TEXTURE_2D;
+	settings.numColorbuffers    = ATTACHMENT_COUNT;
+	settings.minFilter          = GL_NEAREST;
+	settings.maxFilter          = GL_NEAREST;
+	settings.wrapModeHorizontal = GL_CLAMP_TO_EDGE;
+	settings.wrapModeVertical   = GL_CLAMP_TO_EDGE;
+	settings.useDepth           = false;
+
+	// row-major grid order, so neighbouring fragments fetch neighbouring flow and camera texels
+	ofFloatPixels state, color, base, zero;
+	state.allocate(stateWidth, stateHeight, OF_PIXELS_RGBA);
+	color.allocate(stateWidth, stateHeight, OF_PIXELS_RGBA);
+	base.allocate(stateWidth, stateHeight, OF_PIXELS_RGBA);
+	zero.allocate(stateWidth, stateHeight, OF_PIXELS_RGBA);
+	state.set(0.0f);
+	color.set(0.0f);
+	base.set(0.0f);
+	zero.set(0.0f);
+
+	std::vector<glm::vec2> texels(particleCount);
+
+	size_t i = 0;
+	for (int y = 0; y < gridHeight; y++) {
+		for (int x = 0; x < gridWidth; x++, i++) {
+			int   tx = i % stateWidth;
+			int   ty = i / stateWidth;
+			float px = spacing + x * spacing;
+			float py = spacing + y * spacing;
+
+			state.setColor(tx, ty, ofFloatColor(px, py, 0.0f, 0.0f));
+			color.setColor(tx, ty, ofFloatColor(1.0f, 1.0f, 1.0f, spacing));
+			base.setColor(tx, ty, ofFloatColor(px, py, 0.0f, 0.0f));
+			texels[i] = glm::vec2((tx + 0.5f) / stateWidth, (ty + 0.5f) / stateHeight);
+		}
+	}
+
+	for (ofFbo &fbo : fbos) {
+		fbo.allocate(settings);
+		fbo.getTexture(ATTACHMENT_STATE).loadData(state);
+		fbo.getTexture(ATTACHMENT_CONTRIBUTION).loadData(zero);
+		fbo.getTexture(ATTACHMENT_COLOR).loadData(color);
+	}
+	current = 0;
+
+	baseTex.allocate(stateWidth, stateHeight, GL_RGBA32F, false);
+	baseTex.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+	baseTex.loadData(base);
+
+	ofFbo::Settings reduceSettings = settings;
+	reduceSettings.width           = 2; // left, right
+	reduceSettings.numColorbuffers = 1;
+	reduceFbo.allocate(reduceSettings);
+
+	vbo.clear();
+	vbo.setVertexData(texels.data(), texels.size(), GL_STATIC_DRAW);
+
+	ofLogNotice("GpuParticleSystem") << particleCount << " particles in " << stateWidth << "x" << stateHeight
+	                                 << " state textures";
+	bDirty = false;
+	return true;
+}
+
+void GpuParticleSystem::update(const cv::Mat &flowMat, const ofPixels &camera, float deltaTime,
+                               float minLengthSquared, float sourceWidth, float sourceHeight, float particleSize,
+                               bool bMirror) {
+	if (!isSupported() || (bDirty && !allocate()) || particleCount == 0 || !camera.isAllocated()) {
+		return;
+	}
+
+	uploadFlow(flowMat);
+
+	if (!cameraTex.isAllocated() || cameraTex.getWidth() != camera.getWidth()
+	    || cameraTex.getHeight() != camera.getHeight()) {
+		cameraTex.allocate(camera, false);
+		cameraTex.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+	}
+	cameraTex.loadData(camera);
+
+	simulate(deltaTime, minLengthSquared, sourceWidth, sourceHeight, particleSize, bMirror);
+	reduce();
+}
+
+void GpuParticleSystem::uploadFlow(const cv::Mat &flowMat) {
+	static const float noFlow[2] = { 0.0f, 0.0f };
+
+	int cols = flowMat.empty() ? 1 : flowMat.cols;
+	int rows = flowMat.empty() ? 1 : flowMat.rows;
+	if (!flowTex.isAllocated() || flowTex.getWidth() != cols || flowTex.getHeight() != rows) {
+		flowTex.allocate(cols, rows, GL_RG32F, false, GL_RG, GL_FLOAT);
+		flowTex.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+		flowTex.setTextureWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	}
+
+	if (flowMat.empty()) {
+		flowTex.loadData(noFlow, 1, 1, GL_RG);
+	} else if (flowMat.isContinuous()) {
+		flowTex.loadData(flowMat.ptr<float>(0), cols, rows, GL_RG);
+	} else {
+		cv::Mat packed = flowMat.clone();
+		flowTex.loadData(packed.ptr<float>(0), cols, rows, GL_RG);
+	}
+}
+
+void GpuParticleSystem::simulate(float deltaTime, float minLengthSquared, float sourceWidth, float sourceHeight,
+                                 float particleSize, bool bMirror) {
+	ofFbo &src = fbos[current];
+	ofFbo &dst = fbos[1 - current];
+
+	dst.begin();
+	dst.activateAllDrawBuffers();
+	ofPushStyle();
+	ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+
+	simulateShader.begin();
+	simulateShader.setUniformTexture("stateTex", src.getTexture(ATTACHMENT_STATE), 0);
+	simulateShader.setUniformTexture("colorTex", src.getTexture(ATTACHMENT_COLOR), 1);
+	simulateShader.setUniformTexture("baseTex", baseTex, 2);
+	simulateShader.setUniformTexture("flowTex", flowTex, 3);
+	simulateShader.setUniformTexture("cameraTex", cameraTex, 4);
+	simulateShader.setUniform2f("stateSize", stateWidth, stateHeight);
+	simulateShader.setUniform1f("particleCount", particleCount);
+	simulateShader.setUniform2f("sourceSize", sourceWidth, sourceHeight);
+	simulateShader.setUniform2f("flowSize", flowTex.getWidth(), flowTex.getHeight());
+	simulateShader.setUniform2f("cameraSize", cameraTex.getWidth(), cameraTex.getHeight());
+	simulateShader.setUniform1f("minLengthSquared", minLengthSquared);
+	simulateShader.setUniform1f("damping", 1.0f + deltaTime);
+	simulateShader.setUniform1f("flowGain", 30.0f * deltaTime);
+	simulateShader.setUniform1f("springGain", 0.5f * deltaTime);
+	simulateShader.setUniform1f("moveGain", 10.0f * deltaTime);
+	simulateShader.setUniform1f("particleSize", particleSize);
+	simulateShader.setUniform1i("mirror", bMirror);
+
+	ofDrawRectangle(0, 0, stateWidth, stateHeight);
+
+	simulateShader.end();
+	ofPopStyle();
+	dst.end();
+
+	current = 1 - current;
+}
+
+void GpuParticleSystem::reduce() {
+	reduceFbo.begin();
+	ofPushStyle();
+	ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+
+	reduceShader.begin();
+	reduceShader.setUniformTexture("contributionTex", fbos[current].getTexture(ATTACHMENT_CONTRIBUTION), 0);
+	reduceShader.setUniform2f("stateSize", stateWidth, stateHeight);
+
+	ofDrawRectangle(0, 0, 2, stateHeight);
+
+	reduceShader.end();
+	ofPopStyle();
+	reduceFbo.end();
+
+	// synchronous read of 2 x rows texels; rows are summed in a fixed order on the CPU
+	reduceFbo.readToPixels(reducePixels);
+
+	glm::vec2 left(0, 0), right(0, 0);
+	float     leftCount = 0.0f, rightCount = 0.0f;
+	for (size_t y = 0; y < reducePixels.getHeight(); y++) {
+		ofFloatColor l = reducePixels.getColor(0, y);
+		ofFloatColor r = reducePixels.getColor(1, y);
+		left += glm::vec2(l.r, l.g);
+		right += glm::vec2(r.r, r.g);
+		leftCount += l.b;
+		rightCount += r.b;
+	}
+
+	leftFlowVector  = leftCount > 0.0f ? left / leftCount : left;
+	rightFlowVector = rightCount > 0.0f ? right / rightCount : right;
+}
+
+void GpuParticleSystem::draw(float xmult, float ymult) {
+	if (particleCount == 0 || bDirty) {
+		return;
+	}
+
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	ofEnablePointSprites();
+	ofPushStyle();
+	ofEnableBlendMode(OF_BLENDMODE_ADD);
+
+	drawShader.begin();
+	drawShader.setUniformTexture("stateTex", fbos[current].getTexture(ATTACHMENT_STATE), 0);
+	drawShader.setUniformTexture("colorTex", fbos[current].getTexture(ATTACHMENT_COLOR), 1);
+	drawShader.setUniform2f("drawScale", xmult, ymult);
+
+	vbo.draw(GL_POINTS, 0, particleCount);
+
+	drawShader.end();
+
+	ofDisableBlendMode();
+	ofPopStyle();
+	ofDisablePointSprites();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOpenCv.h"
+
+// GPU twin of ParticleSystem. Particle state lives in float textures, one texel per particle,
+// in row-major grid order:
+//   state (ping-pong)   posX, posY, velX, velY
+//   color (ping-pong)   r, g, b, size (size 0 hides the particle)
+//   base                baseX, baseY
+// One fragment pass integrates every particle against the Farneback field (uploaded as an
+// RG32F texture, sampled bilinearly like the CPU path) and samples the camera color at the new
+// position, the same math as updateParticles() + updateColors(). A second pass reduces the
+// per-particle flow into left and right sums per texture row; only those 2 x rows texels come
+// back to the CPU for the paddles.
+// Needs float textures, RG textures and vertex texture fetch, see isSupported().
+class GpuParticleSystem {
+public:
+	// checks the GL extensions and compiles the shaders once; call with a current GL context
+	bool isSupported();
+
+	// records the layout, the GL resources follow on the next update()
+	void generateParticles(int width, int height, float spacing);
+
+	void update(const cv::Mat &flowMat, const ofPixels &camera, float deltaTime, float minLengthSquared,
+	            float sourceWidth, float sourceHeight, float particleSize, bool bMirror);
+
+	void draw(float xmult, float ymult);
+
+	glm::vec2 getLeftFlowVector() const {
+		return leftFlowVector;
+	}
+
+	glm::vec2 getRightFlowVector() const {
+		return rightFlowVector;
+	}
+
+	size_t getParticleCount() const {
+		return particleCount;
+	}
+
+private:
+	static const int MAX_STATE_WIDTH = 1024;
+
+	enum Attachment
+	{
+		ATTACHMENT_STATE,
+		ATTACHMENT_CONTRIBUTION, // flow used by the particle, left flag, valid flag
+		ATTACHMENT_COLOR,
+		ATTACHMENT_COUNT
+	};
+
+	int   supported = -1; // unknown until the first isSupported()
+	bool  bDirty    = false;
+	int   gridWidth = 0, gridHeight = 0;
+	float spacing   = 0.0f;
+
+	size_t particleCount = 0;
+	int    stateWidth    = 0;
+	int    stateHeight   = 0;
+
+	ofFbo     fbos[2];
+	int       current = 0;
+	ofTexture baseTex;
+	ofTexture flowTex;
+	ofTexture cameraTex;
+	ofFbo     reduceFbo;
+	ofVbo     vbo; // one vertex per particle, the vertex is the particle's texel coordinate
+
+	ofShader simulateShader;
+	ofShader reduceShader;
+	ofShader drawShader;
+
+	ofFloatPixels reducePixels;
+
+	glm::vec2 leftFlowVector;
+	glm::vec2 rightFlowVector;
+
+	bool allocate();
+	void uploadFlow(const cv::Mat &flowMat);
+	void simulate(float deltaTime, float minLengthSquared, float sourceWidth, float sourceHeight, float particleSize,
+	              bool bMirror);
+	void reduce();
+};
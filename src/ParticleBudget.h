@@ -0,0 +1,123 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Level of detail for the particle grid. Fed the CPU work time of every frame (update + draw,
+// without the vsync wait), it raises the effective spacing above the user's spacing when the
+// average stays over the budget, and lowers it again once there is room. Particle count goes
+// with 1 / spacing^2, so a step down is only taken when the cost predicted for the denser grid
+// still fits under the budget with some margin; that and the patience counters keep it from
+// oscillating between two spacings. The coarsening is kept as an offset above the user's
+// spacing, so a finer spacing picked by the user applies at once and only the budget's own steps
+// are sticky.
+class ParticleBudget {
+public:
+	enum State
+	{
+		STATE_OFF,
+		STATE_OK,
+		STATE_OVER,  // over budget, coarsening
+		STATE_ROOM,  // room for more particles, refining
+		STATE_LIMIT, // over budget at the coarsest spacing
+	};
+
+	struct Settings {
+		bool  enabled    = true;
+		float budgetMs   = 1000.0f / 120.0f;
+		int   maxSpacing = 32;
+		int   patience   = 10;    // frames over budget before coarsening
+		int   recovery   = 60;    // frames with room before refining
+		float margin     = 0.85f; // a denser grid must be predicted under budget * margin
+		float smoothing  = 0.1f;  // weight of the newest frame in the average
+	};
+
+	Settings settings;
+
+	// returns the spacing to use this frame, never below userSpacing
+	int update(float frameMs, int userSpacing) {
+		if (userSpacing != lastUserSpacing) {
+			offset          = std::min(offset, std::max(0, settings.maxSpacing - userSpacing));
+			lastUserSpacing = userSpacing;
+			restart(); // timings of the old grid
+		}
+		averageMs = averageMs > 0.0f ? ofLerp(averageMs, frameMs, settings.smoothing) : frameMs;
+
+		if (!settings.enabled) {
+			offset = 0;
+			state  = STATE_OFF;
+			return userSpacing;
+		}
+		int spacing = getSpacing(userSpacing);
+
+		float denser    = spacing - 1.0f;
+		float predicted = denser > 0.0f ? averageMs * (spacing * spacing) / (denser * denser) : averageMs;
+
+		if (averageMs > settings.budgetMs) {
+			overFrames++;
+			roomFrames = 0;
+			state      = spacing < settings.maxSpacing ? STATE_OVER : STATE_LIMIT;
+		} else if (spacing > userSpacing && predicted < settings.budgetMs * settings.margin) {
+			roomFrames++;
+			overFrames = 0;
+			state      = STATE_ROOM;
+		} else {
+			overFrames = 0;
+			roomFrames = 0;
+			state      = STATE_OK;
+		}
+
+		if (overFrames >= settings.patience && spacing < settings.maxSpacing) {
+			offset++;
+			restart();
+		} else if (roomFrames >= settings.recovery) {
+			offset--;
+			restart();
+		}
+		return getSpacing(userSpacing);
+	}
+
+	int getSpacing(int userSpacing) const {
+		return settings.enabled ? userSpacing + std::min(offset, std::max(0, settings.maxSpacing - userSpacing))
+		                        : userSpacing;
+	}
+
+	float getAverageMs() const {
+		return averageMs;
+	}
+
+	State getState() const {
+		return state;
+	}
+
+	static const char *stateName(State state) {
+		switch (state) {
+			case STATE_OFF:
+				return "off";
+			case STATE_OK:
+				return "ok";
+			case STATE_OVER:
+				return "over";
+			case STATE_ROOM:
+				return "room";
+			case STATE_LIMIT:
+				return "limit";
+			default:
+				return "?";
+		}
+	}
+
+private:
+	int   offset          = 0; // coarsening steps above the user's spacing
+	int   lastUserSpacing = 0;
+	float averageMs       = 0.0f;
+	int   overFrames      = 0;
+	int   roomFrames      = 0;
+	State state           = STATE_OFF;
+
+	// the grid just changed, the old timings say nothing about the new one
+	void restart() {
+		averageMs  = 0.0f;
+		overFrames = 0;
+		roomFrames = 0;
+	}
+};
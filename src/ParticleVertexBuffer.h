@@ -0,0 +1,187 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <cstddef>
+#include <cstring>
+
+// Grow-only interleaved vertex stream for the particle point sprites. The GL buffer holds
+// REGIONS copies of the vertex array; every frame writes the next region and draws it with a
+// first offset, so the CPU never overwrites vertices the GPU may still be reading. With
+// ARB_buffer_storage the buffer is persistently mapped and vertices are written straight into
+// GL memory, guarded by a fence per region. Otherwise they go through a CPU staging array and
+// one glBufferSubData per frame. Until the first draw() (or without a GL context, e.g. the
+// headless bench) everything lands in the staging array.
+class ParticleVertexBuffer {
+public:
+	struct Vertex {
+		glm::vec2    position;
+		float        size;
+		float        padding; // keeps the color and the whole vertex 16 byte aligned
+		ofFloatColor color;
+	};
+
+	~ParticleVertexBuffer() {
+		releaseGpu();
+	}
+
+	// grows the staging array, never shrinks it; a larger GL buffer follows on the next draw()
+	void reserve(size_t vertices) {
+		if (vertices > capacity) {
+			capacity = vertices;
+			staging.resize(vertices);
+		}
+		count = 0;
+	}
+
+	size_t getCapacity() const {
+		return capacity;
+	}
+
+	size_t getCount() const {
+		return count;
+	}
+
+	// room for getCapacity() vertices, valid until endWrite()
+	Vertex *beginWrite() {
+		bWroteMapped = mapped != nullptr && gpuCapacity == capacity;
+		if (!bWroteMapped) {
+			return staging.data();
+		}
+		region = (region + 1) % REGIONS;
+		waitForRegion(region);
+		return mapped + region * capacity;
+	}
+
+	void endWrite(size_t written) {
+		count = written;
+	}
+
+	// draws the last written vertices as points; the shader reads the per-vertex size from
+	// the "size" attribute, without one every point is fallbackSize pixels
+	void draw(ofShader &shader, float fallbackSize) {
+		if (capacity == 0) {
+			return;
+		}
+		if (gpuCapacity != capacity) {
+			allocateGpu(shader);
+			bWroteMapped = false;
+		}
+
+		if (!bWroteMapped) {
+			region = (region + 1) % REGIONS;
+			if (mapped != nullptr) {
+				waitForRegion(region);
+				memcpy(mapped + region * capacity, staging.data(), count * sizeof(Vertex));
+			} else {
+				buffer.updateData(region * capacity * sizeof(Vertex), count * sizeof(Vertex), staging.data());
+			}
+		}
+		bWroteMapped = false;
+
+		if (count == 0) {
+			return;
+		}
+
+		bool bShader = shader.isLoaded() && sizeLocation >= 0;
+		if (bShader) {
+			shader.begin();
+		} else {
+			glPointSize(fallbackSize);
+		}
+
+		vbo.draw(GL_POINTS, region * capacity, count);
+
+		if (bShader) {
+			shader.end();
+		}
+
+		if (mapped != nullptr) {
+			if (fences[region]) {
+				glDeleteSync(fences[region]);
+			}
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+	}
+
+	bool isPersistentlyMapped() const {
+		return mapped != nullptr;
+	}
+
+private:
+	static const int REGIONS = 3;
+
+	std::vector<Vertex> staging;
+	size_t              capacity     = 0;
+	size_t              count        = 0;
+	bool                bWroteMapped = false;
+
+	ofBufferObject buffer;
+	ofVbo          vbo;
+	size_t         gpuCapacity  = 0;
+	int            region       = 0;
+	int            sizeLocation = -1;
+	Vertex        *mapped       = nullptr;
+	GLsync         fences[REGIONS] {};
+
+	void allocateGpu(ofShader &shader) {
+		releaseGpu();
+
+		GLsizeiptr bytes = REGIONS * capacity * sizeof(Vertex);
+		buffer.allocate();
+
+		if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			buffer.bind(GL_ARRAY_BUFFER);
+			glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+			mapped = static_cast<Vertex *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+			buffer.unbind(GL_ARRAY_BUFFER);
+		}
+		if (mapped == nullptr) {
+			buffer.allocate(bytes, GL_STREAM_DRAW);
+		}
+
+		vbo.setVertexBuffer(buffer, 2, sizeof(Vertex), offsetof(Vertex, position));
+		vbo.setColorBuffer(buffer, sizeof(Vertex), offsetof(Vertex, color));
+
+		sizeLocation = shader.isLoaded() ? shader.getAttributeLocation("size") : -1;
+		if (sizeLocation >= 0) {
+			vbo.setAttributeBuffer(sizeLocation, buffer, 1, sizeof(Vertex), offsetof(Vertex, size));
+		}
+
+		gpuCapacity = capacity;
+		region      = 0;
+		ofLogNotice("ParticleVertexBuffer") << capacity << " particles, "
+		                                    << (mapped ? "persistently mapped" : "glBufferSubData") << " x" << REGIONS;
+	}
+
+	void releaseGpu() {
+		for (GLsync &fence : fences) {
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		if (mapped != nullptr) {
+			buffer.bind(GL_ARRAY_BUFFER);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			buffer.unbind(GL_ARRAY_BUFFER);
+			mapped = nullptr;
+		}
+		// immutable storage cannot be resized, start over with a fresh buffer object
+		vbo.clear();
+		buffer      = ofBufferObject();
+		gpuCapacity = 0;
+	}
+
+	// blocks until the GPU has finished the draw that last read this region
+	void waitForRegion(int r) {
+		if (!fences[r]) {
+			return;
+		}
+		while (glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+		}
+		glDeleteSync(fences[r]);
+		fences[r] = nullptr;
+	}
+};
@@ -1,144 +1,196 @@
 #pragma once
 
 #include "ofGraphicsConstants.h"
+#include "ParticleVertexBuffer.h"
+#include "WorkerPool.h"
 #include "ofMain.h"
 
+#include <array>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_SSE
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Particles live in structure-of-arrays buffers so the update kernel can stream through
+// positions and velocities four at a time with SSE. The scalar kernel does the same math
+// one particle at a time and is used for the tail, on non-SSE builds, and as the reference
+// when comparing the two (setUseSimd()). The particle range is cut into fixed-size chunks that
+// run on a WorkerPool; each chunk keeps its own left/right flow sums and the sums are merged
+// in chunk order, so the paddle input is identical for any thread count. When given the camera
+// image, each chunk also samples its particles' color and size right after moving them, while
+// the chunk is still in cache, straight from the RGB bytes through per-frame lookup tables.
+// Flow is sampled bilinearly between cell centers (nearest cell with setBilinearFlow(false)).
+// Most particles sit at their base position, so each keeps the flow cell index and weights of
+// its base position; only particles that are away from it compute their footprint per frame.
+// The arrays are ordered in tiles of the grid (setLayout()) so a chunk gathers from a compact
+// patch of the flow field and the camera image, and particles pushed out of their patch are
+// periodically sorted back by position (setResortInterval()).
 class ParticleSystem {
 public:
-	struct Particle {
-		glm::vec2    pos;
-		glm::vec2    vel;
-		glm::vec2    basePos;
-		float        size           = 4.0f;
-		bool         bAtBasePos     = true;
-		float        timeNotTouched = 0.0f;
-		ofFloatColor color;
-	};
-
-	ParticleSystem() {
-		glEnable(GL_PROGRAM_POINT_SIZE);
-		ofEnablePointSprites();
-	}
-
 	void clear() {
-		particles.clear();
+		posX.clear();
+		posY.clear();
+		velX.clear();
+		velY.clear();
+		baseX.clear();
+		baseY.clear();
+		size.clear();
+		colors.clear();
+		gridColumns = 0;
+		gridRows    = 0;
 	}
 
+	// Lays out the grid for a new spacing or size without giving up the storage. On an empty
+	// system the particles start at rest on the grid. Otherwise every grid slot inherits position,
+	// velocity and color from the nearest particle of the previous grid and the spring pulls it
+	// to its new base, so spacing changes animate instead of snapping. clear() first to reset.
+	// Particles are stored in the order of setLayout().
 	void generateParticles(int width, int height, float spacing) {
-		clear();
-
 		int   numx   = width / spacing;
 		int   numy   = height / spacing;
 		float offset = spacing;
 
-		particles.reserve(numx * numy);
-
-		for (int x = 0; x < numx; x++) {
-			for (int y = 0; y < numy; y++) {
-				glm::vec2 pos(offset + x * spacing, offset + y * spacing);
-				Particle  particle;
-
-				particle.pos     = pos;
-				particle.size    = spacing;
-				particle.basePos = pos;
-				particle.color   = ofFloatColor(1.0f, 1.0f, 1.0f, 1.0f);
-
-				particles.push_back(particle);
+		size_t count   = numx * numy;
+		bool   animate = getParticleCount() > 0 && gridColumns > 0 && gridRows > 0;
+		if (animate) {
+			posX.swap(previousPosX);
+			posY.swap(previousPosY);
+			velX.swap(previousVelX);
+			velY.swap(previousVelY);
+			baseX.swap(previousBaseX);
+			baseY.swap(previousBaseY);
+			size.swap(previousSize);
+			colors.swap(previousColors);
+
+			// resort() moves particles around, so find them by the grid slot of their base
+			slotParticles.resize((size_t)gridColumns * gridRows);
+			for (size_t j = 0; j < previousBaseX.size(); j++) {
+				int column = nearestGridIndex(previousBaseX[j], gridColumns);
+				int row    = nearestGridIndex(previousBaseY[j], gridRows);
+				slotParticles[(size_t)column * gridRows + row] = j;
 			}
 		}
-	}
-
-	void updateParticles(const cv::Mat &flowMat, float deltaTime, float minLengthSquared, float sourceWidth,
-	                     float sourceHeight, bool bMirror) {
-		leftFlowVector    = glm::vec2(0, 0);
-		rightFlowVector   = glm::vec2(0, 0);
-		size_t leftCount  = 0;
-		size_t rightCount = 0;
 
-		for (auto &particle : particles) {
-			float     percentX  = particle.pos.x / sourceWidth;
-			float     percentY  = particle.pos.y / sourceHeight;
-			glm::vec2 flowForce = getOpticalFlowValueForPercent(flowMat, percentX, percentY, minLengthSquared);
+		// resize() keeps the capacity, only growing past the largest grid so far allocates
+		gridLayout = layout;
+		posX.resize(count);
+		posY.resize(count);
+		velX.resize(count);
+		velY.resize(count);
+		baseX.resize(count);
+		baseY.resize(count);
+		size.resize(count);
+		colors.resize(count);
 
-			if (particle.pos.x + particle.size < sourceWidth / 2.0) {
-				leftFlowVector += flowForce;
-				leftCount++;
-			} else {
-				rightFlowVector += flowForce;
-				rightCount++;
-			}
-
-			float len2 = glm::length2(flowForce);
-			particle.vel /= 1.f + deltaTime;
-
-			if (len2 > minLengthSquared) {
-				particle.vel += flowForce * (30.0f * deltaTime);
-				if (particle.bAtBasePos)
-					particle.timeNotTouched = 0.0f;
-				particle.bAtBasePos = false;
-			} else {
-				particle.timeNotTouched += deltaTime;
-			}
+		for (int x = 0; x < numx; x++) {
+			int previousX = animate ? nearestGridIndex(offset + x * spacing, gridColumns) : 0;
 
-			if (particle.timeNotTouched > 0.1) {
-				particle.timeNotTouched = 0.0;
+			for (int y = 0; y < numy; y++) {
+				size_t i = slotIndex(x, y, numx, numy);
+				baseX[i] = offset + x * spacing;
+				baseY[i] = offset + y * spacing;
+
+				if (animate) {
+					size_t slot = (size_t)previousX * gridRows + nearestGridIndex(baseY[i], gridRows);
+					size_t from = slotParticles[slot];
+					posX[i]     = previousPosX[from];
+					posY[i]     = previousPosY[from];
+					velX[i]     = previousVelX[from];
+					velY[i]     = previousVelY[from];
+					size[i]     = previousSize[from];
+					colors[i]   = previousColors[from];
+				} else {
+					posX[i]   = baseX[i];
+					posY[i]   = baseY[i];
+					velX[i]   = 0.0f;
+					velY[i]   = 0.0f;
+					size[i]   = spacing;
+					colors[i] = ofFloatColor(1.0f, 1.0f, 1.0f, 1.0f);
+				}
 			}
+		}
 
-			glm::vec2 basePos = particle.basePos;
-			glm::vec2 diff    = basePos - particle.pos;
-			float     dist    = glm::length(diff);
+		gridColumns     = numx;
+		gridRows        = numy;
+		gridSpacing     = spacing;
+		restLayout      = RestLayout(); // base positions moved, recompute the flow footprints
+		framesSinceSort = 0;
 
-			if (dist > 0.1f) {
-				glm::vec2 dir = glm::normalize(diff);
-				particle.vel += dir * (dist * 0.5f * deltaTime);
-			}
+		vertexBuffer.reserve(count);
+	}
 
-			particle.vel *= 0.99f;
-			particle.pos += particle.vel * (10.0f * deltaTime);
-		}
+	// positions only, colors and sizes keep their last values
+	void updateParticles(const cv::Mat &flowMat, float deltaTime, float minLengthSquared, float sourceWidth,
+	                     float sourceHeight, bool bMirror) {
+		run(makeParams(flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight));
+	}
 
-		if (leftCount > 0)
-			leftFlowVector /= leftCount;
-		if (rightCount > 0)
-			rightFlowVector /= rightCount;
+	// fused pass: moves every particle and samples its color and size from the camera image at the
+	// new position, same result as updateParticles() followed by updateColors()
+	void updateParticles(const cv::Mat &flowMat, float deltaTime, float minLengthSquared, float sourceWidth,
+	                     float sourceHeight, bool bMirror, const ofPixels &camera, float particle_size) {
+		UpdateParams params = makeParams(flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight);
+		prepareColorSampling(camera, particle_size, bMirror, params);
+		run(params);
 	}
 
+	// reference color pass, kept for comparisons with the fused kernel
 	void updateColors(const ofPixels &pixels, float particle_size, bool bMirror) {
 		int imgW = pixels.getWidth();
 		int imgH = pixels.getHeight();
 
-		for (auto &particle : particles) {
-			int samplex = bMirror ? imgW - (int)particle.pos.x : (int)particle.pos.x;
-			int sampley = (int)particle.pos.y;
+		for (size_t i = 0; i < colors.size(); i++) {
+			int samplex = bMirror ? imgW - (int)posX[i] : (int)posX[i];
+			int sampley = (int)posY[i];
 			if (samplex >= 0 && samplex < imgW && sampley >= 0 && sampley < imgH) {
-				particle.color   = pixels.getColor(samplex, sampley);
-				float brightness = particle.color.getBrightness();
-				particle.size    = particle_size * (brightness * 0.8f + 0.2f);
+				colors[i]        = pixels.getColor(samplex, sampley);
+				float brightness = colors[i].getBrightness();
+				size[i]          = particle_size * (brightness * 0.8f + 0.2f);
 			} else {
 				// Hide out-of-bounds particles visually
-				particle.color.a = 0.0f;
-				particle.size    = 0.0f;
+				colors[i].a = 0.0f;
+				size[i]     = 0.0f;
 			}
 		}
 	}
 
-	void draw(float xmult, float ymult, float particle_size) {
-		mesh.clear();
-		mesh.setMode(OF_PRIMITIVE_PATCHES);
+	// CPU side of drawing, split from draw() so it can be measured without a GL context.
+	// Writes the visible particles into the vertex stream, no allocation.
+	void buildMesh(float xmult, float ymult) {
+		ParticleVertexBuffer::Vertex *out     = vertexBuffer.beginWrite();
+		size_t                        written = 0;
+
+		for (size_t i = 0; i < colors.size(); i++) {
+			if (colors[i].a > 0.0f && size[i] > 0.0f) {
+				ParticleVertexBuffer::Vertex &v = out[written++];
+				v.position                      = glm::vec2(posX[i] * xmult, posY[i] * ymult);
+				v.size                          = size[i];
+				v.color                         = colors[i];
+			}
+		}
+		vertexBuffer.endWrite(written);
+	}
 
-		for (const auto &particle : particles) {
-			if (particle.color.a > 0.0f && particle.size > 0.0f) {
-				glm::vec3 pos3D(particle.pos.x * xmult, particle.pos.y * ymult, 0.0f);
-				mesh.addVertex(pos3D);
-				mesh.addColor(particle.color);
+	// particle_size is only used when the particle shader is missing
+	void draw(float particle_size) {
+		if (!bShaderTried) {
+			bShaderTried = true;
+			if (!shader.load("shaders/particles.vert", "shaders/particles.frag")) {
+				ofLogError("ParticleSystem") << "particle shader failed, drawing fixed size points";
 			}
 		}
 
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		ofEnablePointSprites();
+
 		ofPushStyle();
-		glPointSize(particle_size); // TODO: Fixed size for now (can be dynamic with shader)
 		ofEnableBlendMode(OF_BLENDMODE_ADD);
 
-		mesh.draw();
+		vertexBuffer.draw(shader, particle_size);
 
 		ofDisableBlendMode();
 		ofDisablePointSprites();
@@ -154,36 +206,677 @@ public:
 	}
 
 	size_t getParticleCount() const {
-		return particles.size();
+		return posX.size();
+	}
+
+	// false forces the scalar kernel, for benchmarks and kernel comparisons
+	void setUseSimd(bool useSimd) {
+		bUseSimd = useSimd;
+	}
+
+	// false samples the nearest flow cell, the old blocky lookup
+	void setBilinearFlow(bool bilinear) {
+		bBilinearFlow = bilinear;
+	}
+
+	enum Layout
+	{
+		LAYOUT_COLUMNS, // x outer, y inner, the original order
+		LAYOUT_TILES,   // TILE_SIZE x TILE_SIZE tiles in row-major order, row-major inside a tile
+	};
+
+	// order of the particle arrays, takes effect on the next generateParticles()
+	void setLayout(Layout order) {
+		layout = order;
+	}
+
+	Layout getLayout() const {
+		return gridLayout;
+	}
+
+	// every this many updates particles that drifted away from their slot are sorted back into
+	// layout order by their current position, 0 never sorts
+	void setResortInterval(int updates) {
+		resortInterval = updates;
+	}
+
+	// threads used by updateParticles(), including the calling thread; 0 uses every core
+	void setThreadCount(int threads) {
+		workers.setThreadCount(threads);
+	}
+
+	int getThreadCount() const {
+		return workers.getThreadCount();
+	}
+
+	// largest position difference to another system with the same layout
+	float maxPositionDifference(const ParticleSystem &other) const {
+		float diff = 0.0f;
+		for (size_t i = 0; i < std::min(getParticleCount(), other.getParticleCount()); i++) {
+			diff = std::max(diff, std::max(std::abs(posX[i] - other.posX[i]), std::abs(posY[i] - other.posY[i])));
+		}
+		return diff;
 	}
 
 private:
-	std::vector<Particle> particles;
-	glm::vec2             leftFlowVector;
-	glm::vec2             rightFlowVector;
+	// particle state, one entry per particle in every array
+	std::vector<float>        posX, posY;
+	std::vector<float>        velX, velY;
+	std::vector<float>        baseX, baseY;
+	std::vector<float>        size;
+	std::vector<ofFloatColor> colors;
+
+	// grid of the last generateParticles() and the state it started from
+	int                       gridColumns = 0;
+	int                       gridRows    = 0;
+	float                     gridSpacing = 0.0f;
+	std::vector<float>        previousPosX, previousPosY;
+	std::vector<float>        previousVelX, previousVelY;
+	std::vector<float>        previousBaseX, previousBaseY;
+	std::vector<float>        previousSize;
+	std::vector<ofFloatColor> previousColors;
+	std::vector<size_t>       slotParticles; // particle index by column-major slot of the previous grid
+
+	// Flow rows and camera rows are row-major, so particles that are neighbours in memory should
+	// be neighbours on screen in both directions. Column order walks down a whole column of the
+	// image and touches a new flow row and pixel row for every particle; tiles keep a chunk
+	// within a few flow rows and a band of camera rows.
+	static const int TILE_SIZE = 16;
+
+	Layout layout          = LAYOUT_TILES;
+	Layout gridLayout      = LAYOUT_TILES; // layout of the current grid
+	int    resortInterval  = 120;
+	int    framesSinceSort = 0;
+
+	std::vector<uint32_t> sortKeys;
+	std::vector<uint32_t> sortOffsets;
+	std::vector<uint32_t> sortOrder;
+
+	// array index of grid slot (x, y) in the layout of the current grid
+	size_t slotIndex(int x, int y, int columns, int rows) const {
+		if (gridLayout == LAYOUT_COLUMNS) {
+			return (size_t)x * rows + y;
+		}
+		// every tile row above is full height; edge tiles are narrower or shorter
+		int    tileX      = x / TILE_SIZE;
+		int    tileY      = y / TILE_SIZE;
+		int    tileWidth  = std::min(TILE_SIZE, columns - tileX * TILE_SIZE);
+		int    tileHeight = std::min(TILE_SIZE, rows - tileY * TILE_SIZE);
+		size_t before     = (size_t)tileY * TILE_SIZE * columns + (size_t)tileX * TILE_SIZE * tileHeight;
+		return before + (size_t)(y % TILE_SIZE) * tileWidth + x % TILE_SIZE;
+	}
+
+	template <typename T>
+	void permute(std::vector<T> &values, std::vector<T> &scratch) {
+		scratch.resize(values.size());
+		for (size_t k = 0; k < sortOrder.size(); k++) {
+			scratch[k] = values[sortOrder[k]];
+		}
+		values.swap(scratch);
+	}
+
+	// Counting sort of the particles by the slot nearest to their current position. Particles
+	// resting on their base are already in order, so this only moves the displaced ones and is
+	// skipped entirely when nothing is out of order. Stable, so the result does not depend on
+	// anything but the particle state.
+	void resort() {
+		size_t count = getParticleCount();
+		if (count == 0 || gridColumns == 0 || gridRows == 0) {
+			return;
+		}
+
+		sortKeys.resize(count);
+		bool sorted = true;
+		for (size_t i = 0; i < count; i++) {
+			int column  = nearestGridIndex(posX[i], gridColumns);
+			int row     = nearestGridIndex(posY[i], gridRows);
+			sortKeys[i] = slotIndex(column, row, gridColumns, gridRows);
+			sorted      = sorted && (i == 0 || sortKeys[i] >= sortKeys[i - 1]);
+		}
+		if (sorted) {
+			return;
+		}
+
+		sortOffsets.assign(count + 1, 0);
+		for (size_t i = 0; i < count; i++) {
+			sortOffsets[sortKeys[i] + 1]++;
+		}
+		for (size_t k = 1; k <= count; k++) {
+			sortOffsets[k] += sortOffsets[k - 1];
+		}
+		sortOrder.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			sortOrder[sortOffsets[sortKeys[i]]++] = i;
+		}
+
+		permute(posX, previousPosX);
+		permute(posY, previousPosY);
+		permute(velX, previousVelX);
+		permute(velY, previousVelY);
+		permute(baseX, previousBaseX);
+		permute(baseY, previousBaseY);
+		permute(size, previousSize);
+		permute(colors, previousColors);
+		restLayout = RestLayout(); // the footprints belong to the old order
+	}
+
+	// column or row of the previous grid closest to a coordinate
+	int nearestGridIndex(float coordinate, int gridSize) const {
+		int index = std::lround(coordinate / gridSpacing) - 1;
+		return std::max(0, std::min(index, gridSize - 1));
+	}
+
+	glm::vec2 leftFlowVector;
+	glm::vec2 rightFlowVector;
 
-	ofVboMesh mesh;
-	ofShader  shader;
+	bool bUseSimd      = true;
+	bool bBilinearFlow = true;
 
-	glm::vec2 getOpticalFlowValueForPercent(const cv::Mat &flowMat, float xpct, float ypct, float minLengthSquared) {
-		glm::vec2 flowVector(0, 0);
+	// bilinear footprint of every base position: index of the top-left flow cell and weights
+	std::vector<int32_t> restCell;
+	std::vector<float>   restWeightX, restWeightY;
 
-		if (flowMat.empty()) {
-			return flowVector;
+	// flow layout the footprints were computed for
+	struct RestLayout {
+		float  cols = 0, rows = 0, sourceWidth = 0, sourceHeight = 0;
+		size_t flowStride = 0;
+
+		bool operator==(const RestLayout &o) const {
+			return cols == o.cols && rows == o.rows && sourceWidth == o.sourceWidth && sourceHeight == o.sourceHeight
+			       && flowStride == o.flowStride;
+		}
+	};
+	RestLayout restLayout;
+
+	// particles per job, a multiple of 4 so only the last chunk has a scalar tail
+	static const size_t CHUNK_SIZE = 4096;
+
+	WorkerPool workers;
+
+	ParticleVertexBuffer vertexBuffer;
+	ofShader             shader;
+	bool                 bShaderTried = false;
+
+	// per-frame constants of the update kernel
+	struct UpdateParams {
+		const cv::Point2f *flow;
+		size_t             flowStride; // in cv::Point2f
+		float              cols;
+		float              rows;
+		float              sourceWidth;
+		float              sourceHeight;
+		float              halfWidth;
+		float              minLengthSquared;
+		float              damping;    // velocity is divided by this
+		float              flowGain;   // flow -> velocity
+		float              springGain; // offset from base position -> velocity
+		float              moveGain;   // velocity -> position
+
+		// bilinear flow sampling
+		bool   bilinear;
+		size_t stepX;   // offset to the right neighbour cell, 0 with a single column
+		size_t stepY;   // offset to the cell below, 0 with a single row
+		float  maxLeft; // last column / row that can be a top-left corner
+		float  maxTop;
+
+		// fused color sampling, pixels is null when colors are not updated
+		const unsigned char *pixels;
+		const int           *rowOffsets;   // byte offset of image row y
+		const int           *colOffsets;   // byte offset of the (mirrored) column for particle x, -1 outside
+		int                  imageColumns; // entries in colOffsets
+		int                  imageRows;
+		const float         *sizeTable;    // point size by max(r, g, b)
+		const float         *channelTable; // byte -> float channel
+	};
+
+	// one per chunk, on its own cache line so workers do not share them
+	struct alignas(64) FlowSums {
+		float  leftX      = 0.0f;
+		float  leftY      = 0.0f;
+		float  rightX     = 0.0f;
+		float  rightY     = 0.0f;
+		size_t leftCount  = 0;
+		size_t rightCount = 0;
+	};
+
+	std::vector<FlowSums> chunkSums;
+
+	std::vector<int>       rowOffsets;
+	std::vector<int>       colOffsets;
+	std::array<float, 256> sizeTable;
+
+	// exact byte -> float channel conversion, as ofFloatColor(ofColor)
+	static const std::array<float, 256> &byteToFloat() {
+		static const std::array<float, 256> table = [] {
+			std::array<float, 256> t;
+			for (int i = 0; i < 256; i++) {
+				t[i] = ofFloatColor(ofColor(i, i, i)).r;
+			}
+			return t;
+		}();
+		return table;
+	}
+
+	void prepareColorSampling(const ofPixels &camera, float particle_size, bool bMirror, UpdateParams &p) {
+		int width    = camera.getWidth();
+		int height   = camera.getHeight();
+		int channels = camera.getNumChannels();
+		if (!camera.isAllocated() || channels < 3) {
+			return;
+		}
+
+		rowOffsets.resize(height);
+		for (int y = 0; y < height; y++) {
+			rowOffsets[y] = y * camera.getBytesStride();
+		}
+
+		// particle x -> sampled column, same int truncation and mirror as updateColors()
+		colOffsets.resize(width + 1);
+		for (int x = 0; x <= width; x++) {
+			int sample    = bMirror ? width - x : x;
+			colOffsets[x] = sample >= 0 && sample < width ? sample * channels : -1;
+		}
+
+		for (int b = 0; b < 256; b++) {
+			sizeTable[b] = particle_size * (byteToFloat()[b] * 0.8f + 0.2f);
+		}
+
+		p.pixels       = camera.getData();
+		p.rowOffsets   = rowOffsets.data();
+		p.colOffsets   = colOffsets.data();
+		p.imageColumns = colOffsets.size();
+		p.imageRows    = height;
+		p.sizeTable    = sizeTable.data();
+		p.channelTable = byteToFloat().data();
+	}
+
+	void sampleColors(size_t begin, size_t end, const UpdateParams &p) {
+		for (size_t i = begin; i < end; i++) {
+			int x = (int)posX[i];
+			int y = (int)posY[i];
+			int column;
+			if ((unsigned)x < (unsigned)p.imageColumns && (unsigned)y < (unsigned)p.imageRows
+			    && (column = p.colOffsets[x]) >= 0) {
+				const unsigned char *rgb = p.pixels + p.rowOffsets[y] + column;
+				ofFloatColor        &c   = colors[i];
+				c.r                      = p.channelTable[rgb[0]];
+				c.g                      = p.channelTable[rgb[1]];
+				c.b                      = p.channelTable[rgb[2]];
+				c.a                      = 1.0f;
+				size[i]                  = p.sizeTable[std::max(rgb[0], std::max(rgb[1], rgb[2]))];
+			} else {
+				// Hide out-of-bounds particles visually
+				colors[i].a = 0.0f;
+				size[i]     = 0.0f;
+			}
+		}
+	}
+
+	UpdateParams makeParams(const cv::Mat &flowMat, float deltaTime, float minLengthSquared, float sourceWidth,
+	                        float sourceHeight) const {
+		// without a flow field every particle samples this single zero cell
+		static const cv::Point2f noFlow(0.0f, 0.0f);
+
+		UpdateParams p;
+		bool         hasFlow = !flowMat.empty();
+		p.flow               = hasFlow ? flowMat.ptr<cv::Point2f>(0) : &noFlow;
+		p.flowStride         = hasFlow ? flowMat.step1() / 2 : 0;
+		p.cols               = hasFlow ? flowMat.cols : 1;
+		p.rows               = hasFlow ? flowMat.rows : 1;
+		p.sourceWidth        = sourceWidth;
+		p.sourceHeight       = sourceHeight;
+		p.halfWidth          = sourceWidth / 2.0f;
+		p.minLengthSquared   = minLengthSquared;
+		p.damping            = 1.0f + deltaTime;
+		p.flowGain           = 30.0f * deltaTime;
+		p.springGain         = 0.5f * deltaTime; // normalize(diff) * dist * 0.5 * dt without the sqrt
+		p.moveGain           = 10.0f * deltaTime;
+		p.bilinear           = bBilinearFlow;
+		p.stepX              = p.cols > 1 ? 1 : 0;
+		p.stepY              = p.rows > 1 ? p.flowStride : 0;
+		p.maxLeft            = p.cols - 1 - (p.cols > 1 ? 1 : 0);
+		p.maxTop             = p.rows - 1 - (p.rows > 1 ? 1 : 0);
+		p.pixels             = nullptr;
+		return p;
+	}
+
+	// top-left flow cell and weights of the bilinear footprint around (x, y); flow values sit at
+	// cell centers, hence the half cell shift
+	static void bilinearCell(float x, float y, const UpdateParams &p, int32_t &index, float &wx, float &wy) {
+		float u  = ofClamp((x / p.sourceWidth) * p.cols - 0.5f, 0.0f, p.cols - 1.0f);
+		float v  = ofClamp((y / p.sourceHeight) * p.rows - 0.5f, 0.0f, p.rows - 1.0f);
+		float x0 = std::min((float)(int)u, p.maxLeft);
+		float y0 = std::min((float)(int)v, p.maxTop);
+		wx       = u - x0;
+		wy       = v - y0;
+		index    = (int32_t)(y0 * p.flowStride + x0);
+	}
+
+	static void bilinearFlow(int32_t index, float wx, float wy, const UpdateParams &p, float &fx, float &fy) {
+		const cv::Point2f &c00 = p.flow[index];
+		const cv::Point2f &c10 = p.flow[index + p.stepX];
+		const cv::Point2f &c01 = p.flow[index + p.stepY];
+		const cv::Point2f &c11 = p.flow[index + p.stepY + p.stepX];
+
+		float topX    = c00.x + (c10.x - c00.x) * wx;
+		float topY    = c00.y + (c10.y - c00.y) * wx;
+		float bottomX = c01.x + (c11.x - c01.x) * wx;
+		float bottomY = c01.y + (c11.y - c01.y) * wx;
+		fx            = topX + (bottomX - topX) * wy;
+		fy            = topY + (bottomY - topY) * wy;
+	}
+
+	void updateRestCells(const UpdateParams &p) {
+		RestLayout layout;
+		layout.cols         = p.cols;
+		layout.rows         = p.rows;
+		layout.sourceWidth  = p.sourceWidth;
+		layout.sourceHeight = p.sourceHeight;
+		layout.flowStride   = p.flowStride;
+		if (layout == restLayout && restCell.size() == getParticleCount()) {
+			return;
+		}
+
+		restCell.resize(getParticleCount());
+		restWeightX.resize(getParticleCount());
+		restWeightY.resize(getParticleCount());
+		for (size_t i = 0; i < getParticleCount(); i++) {
+			bilinearCell(baseX[i], baseY[i], p, restCell[i], restWeightX[i], restWeightY[i]);
+		}
+		restLayout = layout;
+	}
+
+	void run(const UpdateParams &params) {
+		if (resortInterval > 0 && ++framesSinceSort >= resortInterval) {
+			resort();
+			framesSinceSort = 0;
+		}
+		if (params.bilinear) {
+			updateRestCells(params);
+		}
+
+		size_t count  = getParticleCount();
+		size_t chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		chunkSums.assign(chunks, FlowSums());
+
+		workers.parallelFor(chunks, [&](size_t chunk) {
+			size_t begin = chunk * CHUNK_SIZE;
+			size_t end   = std::min(begin + CHUNK_SIZE, count);
+#ifdef PARTICLES_SSE
+			if (bUseSimd) {
+				updateRangeSse(begin, end, params, chunkSums[chunk]);
+			} else
+#endif
+			{
+				updateRangeScalar(begin, end, params, chunkSums[chunk]);
+			}
+
+			// the chunk's positions are still in cache
+			if (params.pixels) {
+				sampleColors(begin, end, params);
+			}
+		});
+
+		FlowSums sums;
+		for (const FlowSums &partial : chunkSums) {
+			sums.leftX += partial.leftX;
+			sums.leftY += partial.leftY;
+			sums.rightX += partial.rightX;
+			sums.rightY += partial.rightY;
+			sums.leftCount += partial.leftCount;
+			sums.rightCount += partial.rightCount;
 		}
 
-		int tx = xpct * static_cast<float>(flowMat.cols);
-		int ty = ypct * static_cast<float>(flowMat.rows);
+		leftFlowVector  = glm::vec2(sums.leftX, sums.leftY);
+		rightFlowVector = glm::vec2(sums.rightX, sums.rightY);
+
+		if (sums.leftCount > 0)
+			leftFlowVector /= sums.leftCount;
+		if (sums.rightCount > 0)
+			rightFlowVector /= sums.rightCount;
+	}
+
+	void updateRangeScalar(size_t begin, size_t end, const UpdateParams &p, FlowSums &sums) {
+		for (size_t i = begin; i < end; i++) {
+			float x = posX[i];
+			float y = posY[i];
+
+			float dx     = baseX[i] - x;
+			float dy     = baseY[i] - y;
+			bool  atBase = !(dx * dx + dy * dy > 0.01f);
+
+			float fx, fy;
+			if (p.bilinear) {
+				if (atBase) {
+					bilinearFlow(restCell[i], restWeightX[i], restWeightY[i], p, fx, fy);
+				} else {
+					int32_t index;
+					float   wx, wy;
+					bilinearCell(x, y, p, index, wx, wy);
+					bilinearFlow(index, wx, wy, p, fx, fy);
+				}
+			} else {
+				// nearest flow cell, same truncation as the original percent lookup
+				float cx = ofClamp((x / p.sourceWidth) * p.cols, 0.0f, p.cols - 1.0f);
+				float cy = ofClamp((y / p.sourceHeight) * p.rows, 0.0f, p.rows - 1.0f);
+
+				const cv::Point2f &f = p.flow[(size_t)(int)cy * p.flowStride + (int)cx];
+				fx                   = f.x;
+				fy                   = f.y;
+			}
+
+			float len2 = fx * fx + fy * fy;
+			if (!(len2 > p.minLengthSquared)) {
+				fx = 0.0f;
+				fy = 0.0f;
+			}
 
-		tx = ofClamp(tx, 0, flowMat.cols - 1);
-		ty = ofClamp(ty, 0, flowMat.rows - 1);
+			if (x + size[i] < p.halfWidth) {
+				sums.leftX += fx;
+				sums.leftY += fy;
+				sums.leftCount++;
+			} else {
+				sums.rightX += fx;
+				sums.rightY += fy;
+				sums.rightCount++;
+			}
 
-		const cv::Point2f &fxy = flowMat.at<cv::Point2f>(ty, tx);
-		flowVector             = glm::vec2(fxy.x, fxy.y);
+			float vx = velX[i] / p.damping + fx * p.flowGain;
+			float vy = velY[i] / p.damping + fy * p.flowGain;
+
+			if (!atBase) {
+				vx += dx * p.springGain;
+				vy += dy * p.springGain;
+			}
 
-		if (glm::length2(flowVector) > minLengthSquared) {
-			return flowVector;
+			vx *= 0.99f;
+			vy *= 0.99f;
+
+			velX[i] = vx;
+			velY[i] = vy;
+			posX[i] = x + vx * p.moveGain;
+			posY[i] = y + vy * p.moveGain;
 		}
-		return glm::vec2(0.0, 0.0);
 	}
+
+#ifdef PARTICLES_SSE
+	// bilinearCell() + bilinearFlow() for particles i .. i + 3; lanes not in far use the cached
+	// footprint of their base position
+	void sampleBilinearSse(size_t i, __m128 x, __m128 y, __m128 far, const UpdateParams &p, __m128 &fx,
+	                       __m128 &fy) const {
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 u  = _mm_mul_ps(_mm_div_ps(x, _mm_set1_ps(p.sourceWidth)), _mm_set1_ps(p.cols));
+		__m128 v  = _mm_mul_ps(_mm_div_ps(y, _mm_set1_ps(p.sourceHeight)), _mm_set1_ps(p.rows));
+		u         = _mm_min_ps(_mm_max_ps(_mm_sub_ps(u, half), zero), _mm_set1_ps(p.cols - 1.0f));
+		v         = _mm_min_ps(_mm_max_ps(_mm_sub_ps(v, half), zero), _mm_set1_ps(p.rows - 1.0f));
+		__m128 x0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(u)), _mm_set1_ps(p.maxLeft));
+		__m128 y0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), _mm_set1_ps(p.maxTop));
+
+		__m128  wx    = _mm_sub_ps(u, x0);
+		__m128  wy    = _mm_sub_ps(v, y0);
+		__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(y0, _mm_set1_ps(p.flowStride)), x0));
+
+		__m128i farInt = _mm_castps_si128(far);
+		index          = _mm_or_si128(_mm_and_si128(farInt, index),
+		                              _mm_andnot_si128(farInt, _mm_loadu_si128((const __m128i *)&restCell[i])));
+		wx             = _mm_or_ps(_mm_and_ps(far, wx), _mm_andnot_ps(far, _mm_loadu_ps(&restWeightX[i])));
+		wy             = _mm_or_ps(_mm_and_ps(far, wy), _mm_andnot_ps(far, _mm_loadu_ps(&restWeightY[i])));
+
+		__m128 c00x, c00y, c10x, c10y, c01x, c01y, c11x, c11y;
+#ifdef __AVX2__
+		// flow is interleaved x, y floats
+		const float  *flow  = &p.flow[0].x;
+		const __m128i right = _mm_set1_epi32(2 * p.stepX);
+		const __m128i below = _mm_set1_epi32(2 * p.stepY);
+		const __m128i one   = _mm_set1_epi32(1);
+
+		__m128i i00 = _mm_add_epi32(index, index);
+		__m128i i10 = _mm_add_epi32(i00, right);
+		__m128i i01 = _mm_add_epi32(i00, below);
+		__m128i i11 = _mm_add_epi32(i01, right);
+		c00x        = _mm_i32gather_ps(flow, i00, 4);
+		c00y        = _mm_i32gather_ps(flow, _mm_add_epi32(i00, one), 4);
+		c10x        = _mm_i32gather_ps(flow, i10, 4);
+		c10y        = _mm_i32gather_ps(flow, _mm_add_epi32(i10, one), 4);
+		c01x        = _mm_i32gather_ps(flow, i01, 4);
+		c01y        = _mm_i32gather_ps(flow, _mm_add_epi32(i01, one), 4);
+		c11x        = _mm_i32gather_ps(flow, i11, 4);
+		c11y        = _mm_i32gather_ps(flow, _mm_add_epi32(i11, one), 4);
+#else
+		// SSE2 has no gather
+		alignas(16) int32_t cell[4];
+		alignas(16) float   corners[8][4];
+		_mm_store_si128((__m128i *)cell, index);
+		for (int k = 0; k < 4; k++) {
+			const cv::Point2f &a = p.flow[cell[k]];
+			const cv::Point2f &b = p.flow[cell[k] + p.stepX];
+			const cv::Point2f &c = p.flow[cell[k] + p.stepY];
+			const cv::Point2f &d = p.flow[cell[k] + p.stepY + p.stepX];
+			corners[0][k]        = a.x;
+			corners[1][k]        = a.y;
+			corners[2][k]        = b.x;
+			corners[3][k]        = b.y;
+			corners[4][k]        = c.x;
+			corners[5][k]        = c.y;
+			corners[6][k]        = d.x;
+			corners[7][k]        = d.y;
+		}
+		c00x = _mm_load_ps(corners[0]);
+		c00y = _mm_load_ps(corners[1]);
+		c10x = _mm_load_ps(corners[2]);
+		c10y = _mm_load_ps(corners[3]);
+		c01x = _mm_load_ps(corners[4]);
+		c01y = _mm_load_ps(corners[5]);
+		c11x = _mm_load_ps(corners[6]);
+		c11y = _mm_load_ps(corners[7]);
+#endif
+
+		__m128 topX    = _mm_add_ps(c00x, _mm_mul_ps(_mm_sub_ps(c10x, c00x), wx));
+		__m128 topY    = _mm_add_ps(c00y, _mm_mul_ps(_mm_sub_ps(c10y, c00y), wx));
+		__m128 bottomX = _mm_add_ps(c01x, _mm_mul_ps(_mm_sub_ps(c11x, c01x), wx));
+		__m128 bottomY = _mm_add_ps(c01y, _mm_mul_ps(_mm_sub_ps(c11y, c01y), wx));
+		fx             = _mm_add_ps(topX, _mm_mul_ps(_mm_sub_ps(bottomX, topX), wy));
+		fy             = _mm_add_ps(topY, _mm_mul_ps(_mm_sub_ps(bottomY, topY), wy));
+	}
+
+	void updateRangeSse(size_t begin, size_t end, const UpdateParams &p, FlowSums &sums) {
+		const __m128 sourceW    = _mm_set1_ps(p.sourceWidth);
+		const __m128 sourceH    = _mm_set1_ps(p.sourceHeight);
+		const __m128 cols       = _mm_set1_ps(p.cols);
+		const __m128 rows       = _mm_set1_ps(p.rows);
+		const __m128 maxCol     = _mm_set1_ps(p.cols - 1.0f);
+		const __m128 maxRow     = _mm_set1_ps(p.rows - 1.0f);
+		const __m128 zero       = _mm_setzero_ps();
+		const __m128 halfW      = _mm_set1_ps(p.halfWidth);
+		const __m128 minLen2    = _mm_set1_ps(p.minLengthSquared);
+		const __m128 damping    = _mm_set1_ps(p.damping);
+		const __m128 flowGain   = _mm_set1_ps(p.flowGain);
+		const __m128 springGain = _mm_set1_ps(p.springGain);
+		const __m128 moveGain   = _mm_set1_ps(p.moveGain);
+		const __m128 minDist2   = _mm_set1_ps(0.01f);
+		const __m128 friction   = _mm_set1_ps(0.99f);
+
+		__m128  leftX = zero, leftY = zero, rightX = zero, rightY = zero;
+		__m128i leftCount = _mm_setzero_si128();
+
+		alignas(16) int32_t cellX[4], cellY[4];
+		alignas(16) float   flowX[4], flowY[4];
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			__m128 x = _mm_loadu_ps(&posX[i]);
+			__m128 y = _mm_loadu_ps(&posY[i]);
+
+			__m128 dx  = _mm_sub_ps(_mm_loadu_ps(&baseX[i]), x);
+			__m128 dy  = _mm_sub_ps(_mm_loadu_ps(&baseY[i]), y);
+			__m128 far = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), minDist2);
+
+			__m128 fx, fy;
+			if (p.bilinear) {
+				sampleBilinearSse(i, x, y, far, p, fx, fy);
+			} else {
+				__m128 cx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_div_ps(x, sourceW), cols), zero), maxCol);
+				__m128 cy = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_div_ps(y, sourceH), rows), zero), maxRow);
+				_mm_store_si128((__m128i *)cellX, _mm_cvttps_epi32(cx));
+				_mm_store_si128((__m128i *)cellY, _mm_cvttps_epi32(cy));
+
+				// SSE2 has no gather
+				for (int k = 0; k < 4; k++) {
+					const cv::Point2f &f = p.flow[(size_t)cellY[k] * p.flowStride + cellX[k]];
+					flowX[k]             = f.x;
+					flowY[k]             = f.y;
+				}
+				fx = _mm_load_ps(flowX);
+				fy = _mm_load_ps(flowY);
+			}
+
+			__m128 len2    = _mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy));
+			__m128 touched = _mm_cmpgt_ps(len2, minLen2);
+			fx             = _mm_and_ps(fx, touched);
+			fy             = _mm_and_ps(fy, touched);
+
+			__m128 isLeft = _mm_cmplt_ps(_mm_add_ps(x, _mm_loadu_ps(&size[i])), halfW);
+			leftX         = _mm_add_ps(leftX, _mm_and_ps(fx, isLeft));
+			leftY         = _mm_add_ps(leftY, _mm_and_ps(fy, isLeft));
+			rightX        = _mm_add_ps(rightX, _mm_andnot_ps(isLeft, fx));
+			rightY        = _mm_add_ps(rightY, _mm_andnot_ps(isLeft, fy));
+			leftCount     = _mm_sub_epi32(leftCount, _mm_castps_si128(isLeft)); // true lanes are -1
+
+			__m128 vx = _mm_add_ps(_mm_div_ps(_mm_loadu_ps(&velX[i]), damping), _mm_mul_ps(fx, flowGain));
+			__m128 vy = _mm_add_ps(_mm_div_ps(_mm_loadu_ps(&velY[i]), damping), _mm_mul_ps(fy, flowGain));
+
+			vx = _mm_add_ps(vx, _mm_and_ps(_mm_mul_ps(dx, springGain), far));
+			vy = _mm_add_ps(vy, _mm_and_ps(_mm_mul_ps(dy, springGain), far));
+
+			vx = _mm_mul_ps(vx, friction);
+			vy = _mm_mul_ps(vy, friction);
+
+			_mm_storeu_ps(&velX[i], vx);
+			_mm_storeu_ps(&velY[i], vy);
+			_mm_storeu_ps(&posX[i], _mm_add_ps(x, _mm_mul_ps(vx, moveGain)));
+			_mm_storeu_ps(&posY[i], _mm_add_ps(y, _mm_mul_ps(vy, moveGain)));
+		}
+
+		alignas(16) float   lanes[4];
+		alignas(16) int32_t counts[4];
+		auto                horizontal = [&](__m128 v) {
+			_mm_store_ps(lanes, v);
+			return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+		};
+
+		sums.leftX += horizontal(leftX);
+		sums.leftY += horizontal(leftY);
+		sums.rightX += horizontal(rightX);
+		sums.rightY += horizontal(rightY);
+
+		_mm_store_si128((__m128i *)counts, leftCount);
+		size_t vectorLeft = counts[0] + counts[1] + counts[2] + counts[3];
+		sums.leftCount += vectorLeft;
+		sums.rightCount += (i - begin) - vectorLeft;
+
+		updateRangeScalar(i, end, p, sums);
+	}
+#endif
 };
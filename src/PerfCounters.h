@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling thread for the benchmarks, through perf_event_open on
+// Linux. Each counter is opened on its own, so a machine or VM that lacks one (or a
+// perf_event_paranoid setting that forbids them) just reports it as unavailable; elsewhere
+// every counter is unavailable. Only user space is counted, and only the calling thread, so
+// measure with the particle system set to one thread.
+class PerfCounters {
+public:
+	enum Counter
+	{
+		COUNTER_CYCLES,
+		COUNTER_INSTRUCTIONS,
+		COUNTER_CACHE_REFERENCES, // last level cache
+		COUNTER_CACHE_MISSES,     // last level cache
+		COUNTER_L1D_MISSES,       // L1 data cache read misses
+		COUNTER_COUNT
+	};
+
+	struct Values {
+		int64_t counts[COUNTER_COUNT]; // -1 when the counter is unavailable
+	};
+
+	PerfCounters() {
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			fds[c] = openCounter((Counter)c);
+		}
+	}
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	PerfCounters(const PerfCounters &)            = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+
+	bool isAvailable() const {
+		for (int fd : fds) {
+			if (fd >= 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// resets and starts every available counter
+	void start() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	// stops the counters and returns the counts since start()
+	Values stop() {
+		Values values;
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			values.counts[c] = -1;
+#ifdef __linux__
+			uint64_t count = 0;
+			if (fds[c] >= 0) {
+				ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fds[c], &count, sizeof(count)) == sizeof(count)) {
+					values.counts[c] = count;
+				}
+			}
+#endif
+		}
+		return values;
+	}
+
+	static const char *counterName(int counter) {
+		switch (counter) {
+			case COUNTER_CYCLES:
+				return "cycles";
+			case COUNTER_INSTRUCTIONS:
+				return "instructions";
+			case COUNTER_CACHE_REFERENCES:
+				return "cacheReferences";
+			case COUNTER_CACHE_MISSES:
+				return "cacheMisses";
+			case COUNTER_L1D_MISSES:
+				return "l1dMisses";
+			default:
+				return "?";
+		}
+	}
+
+private:
+	int fds[COUNTER_COUNT];
+
+	static int openCounter(Counter counter) {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size           = sizeof(attr);
+		attr.type           = PERF_TYPE_HARDWARE;
+		attr.disabled       = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+
+		switch (counter) {
+			case COUNTER_CYCLES:
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case COUNTER_INSTRUCTIONS:
+				attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case COUNTER_CACHE_REFERENCES:
+				attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+				break;
+			case COUNTER_CACHE_MISSES:
+				attr.config = PERF_COUNT_HW_CACHE_MISSES;
+				break;
+			case COUNTER_L1D_MISSES:
+				attr.type   = PERF_TYPE_HW_CACHE;
+				attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				              | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+				break;
+			default:
+				return -1;
+		}
+		// this thread, any CPU
+		return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+		(void)counter;
+		return -1;
+#endif
+	}
+};
@@ -0,0 +1,134 @@
+#include "Profiler.h"
+
+const char *Profiler::stageName(int stage) {
+	switch (stage) {
+		case STAGE_CAMERA:
+			return "camera";
+		case STAGE_GRAY:
+			return "gray";
+		case STAGE_FLOW:
+			return "flow";
+		case STAGE_PARTICLES:
+			return "particles";
+		case STAGE_MESH:
+			return "mesh";
+		case STAGE_ASCII:
+			return "ascii";
+		case STAGE_POST:
+			return "post";
+		case STAGE_DETECTION:
+			return "detection";
+		default:
+			return "?";
+	}
+}
+
+ofColor Profiler::stageColor(int stage) {
+	return ofColor::fromHsb((stage * 255) / STAGE_COUNT, 200, 230);
+}
+
+void Profiler::drawOverlay(float x, float y, float width, float height) const {
+	if (!bEnabled) {
+		return;
+	}
+
+	// vertical scale: two frame budgets fill the graph
+	float pxPerMs  = height / (budgetMs * 2.0f);
+	float barWidth = width / FRAME_CAPACITY;
+
+	ofPushStyle();
+	ofSetColor(0, 0, 0, 180);
+	ofDrawRectangle(x, y, width, height);
+
+	ofMesh bars;
+	bars.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	size_t count = std::min(frameHead, FRAME_CAPACITY);
+	for (size_t i = 0; i < count; i++) {
+		const FrameSample &sample = frames[(frameHead - count + i) % FRAME_CAPACITY];
+
+		float left   = x + (FRAME_CAPACITY - count + i) * barWidth;
+		float bottom = y + height;
+
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			float h = std::min(sample.stageMs[s] * pxPerMs, bottom - y);
+			if (h <= 0.0f) {
+				continue;
+			}
+
+			ofFloatColor c = stageColor(s);
+			glm::vec3    a(left, bottom - h, 0), b(left + barWidth, bottom - h, 0);
+			glm::vec3    d(left, bottom, 0), e(left + barWidth, bottom, 0);
+			for (const auto &v : { a, b, d, b, e, d }) {
+				bars.addVertex(v);
+				bars.addColor(c);
+			}
+			bottom -= h;
+		}
+
+		// total frame time as a thin white tick, hitches stand out above the stacked stages
+		float frameY = std::max(y, y + height - sample.frameMs * pxPerMs);
+		ofFloatColor white(1, 1, 1, 0.8f);
+		for (const auto &v : { glm::vec3(left, frameY, 0), glm::vec3(left + barWidth, frameY, 0),
+		                       glm::vec3(left, frameY + 1, 0), glm::vec3(left + barWidth, frameY, 0),
+		                       glm::vec3(left + barWidth, frameY + 1, 0), glm::vec3(left, frameY + 1, 0) }) {
+			bars.addVertex(v);
+			bars.addColor(white);
+		}
+	}
+	bars.draw();
+
+	ofSetColor(255, 0, 0);
+	float budgetY = y + height - budgetMs * pxPerMs;
+	ofDrawLine(x, budgetY, x + width, budgetY);
+
+	// legend with the latest frame's numbers
+	if (count > 0) {
+		const FrameSample &last = frames[(frameHead - 1) % FRAME_CAPACITY];
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			ofSetColor(stageColor(s));
+			ofDrawBitmapString(std::string(stageName(s)) + " " + ofToString(last.stageMs[s], 2), x + width + 8,
+			                   y + 12 + s * 14);
+		}
+		ofSetColor(255);
+		ofDrawBitmapString("frame " + ofToString(last.frameMs, 2) + " ms", x + width + 8, y + 12 + STAGE_COUNT * 14);
+	}
+	ofPopStyle();
+}
+
+bool Profiler::dumpTrace(const std::string &path) const {
+	ofJson trace;
+	trace["displayTimeUnit"] = "ms";
+	trace["traceEvents"]     = ofJson::array();
+
+	uint64_t head  = eventHead.load(std::memory_order_acquire);
+	uint64_t first = head > EVENT_CAPACITY ? head - EVENT_CAPACITY : 0;
+
+	for (uint64_t index = first; index < head; index++) {
+		const Event &event = events[index & (EVENT_CAPACITY - 1)];
+		if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+			continue; // overwritten or still being written
+		}
+
+		uint64_t start = event.start.load(std::memory_order_relaxed);
+		uint64_t end   = event.end.load(std::memory_order_relaxed);
+		int      stage = event.stage.load(std::memory_order_relaxed);
+		int      tid   = event.thread.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (event.sequence.load(std::memory_order_acquire) != index + 1) {
+			continue;
+		}
+
+		trace["traceEvents"].push_back({ { "name", stageName(stage) },
+		                                 { "ph", "X" },
+		                                 { "ts", start },
+		                                 { "dur", end - start },
+		                                 { "pid", 1 },
+		                                 { "tid", tid } });
+	}
+
+	bool ok = ofSaveJson(path, trace);
+	ofLogNotice("Profiler") << "Wrote " << trace["traceEvents"].size() << " trace events to " << path;
+	return ok;
+}
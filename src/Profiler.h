@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+// Frame-time profiler. Profiler::Scope timers add their duration to a per-stage accumulator
+// (any thread, lock-free), endFrame() moves the accumulators into a ring of frame samples that
+// drawOverlay() renders as a stacked frame graph. Every scope is also written to a lock-free
+// event ring that dumpTrace() saves as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Timings are CPU wall time; GPU work shows up where the driver blocks on it.
+class Profiler {
+public:
+	enum Stage
+	{
+		STAGE_CAMERA,
+		STAGE_GRAY,
+		STAGE_FLOW,
+		STAGE_PARTICLES,
+		STAGE_MESH,
+		STAGE_ASCII,
+		STAGE_POST,
+		STAGE_DETECTION,
+		STAGE_COUNT
+	};
+
+	struct FrameSample {
+		std::array<float, STAGE_COUNT> stageMs;
+		float                          frameMs;
+	};
+
+	class Scope {
+	public:
+		Scope(Stage stage) : stage(stage), start(Profiler::now()) {
+		}
+
+		~Scope() {
+			Profiler::global().record(stage, start, Profiler::now());
+		}
+
+	private:
+		Stage    stage;
+		uint64_t start;
+	};
+
+	static Profiler &global() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// microseconds on a monotonic clock
+	static uint64_t now() {
+		using namespace std::chrono;
+		return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	static const char *stageName(int stage);
+	static ofColor     stageColor(int stage);
+
+	void record(Stage stage, uint64_t start, uint64_t end) {
+		stageMicros[stage].fetch_add(end - start, std::memory_order_relaxed);
+
+		uint64_t index = eventHead.fetch_add(1, std::memory_order_relaxed);
+		Event   &event = events[index & (EVENT_CAPACITY - 1)];
+		event.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		event.stage.store(stage, std::memory_order_relaxed);
+		event.thread.store(threadIndex(), std::memory_order_relaxed);
+		event.start.store(start, std::memory_order_relaxed);
+		event.end.store(end, std::memory_order_relaxed);
+		event.sequence.store(index + 1, std::memory_order_release);
+	}
+
+	// render thread, once per frame
+	void endFrame() {
+		uint64_t t = now();
+
+		FrameSample &sample = frames[frameHead % FRAME_CAPACITY];
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			sample.stageMs[s] = stageMicros[s].exchange(0, std::memory_order_relaxed) / 1000.0f;
+		}
+		sample.frameMs = lastFrameEnd > 0 ? (t - lastFrameEnd) / 1000.0f : 0.0f;
+		lastFrameEnd   = t;
+		frameHead++;
+	}
+
+	void setEnabled(bool enabled) {
+		bEnabled = enabled;
+	}
+
+	bool isEnabled() const {
+		return bEnabled;
+	}
+
+	void setBudgetMs(float ms) {
+		budgetMs = ms;
+	}
+
+	void drawOverlay(float x, float y, float width, float height) const;
+
+	// writes the events still in the ring, returns false if the file could not be written
+	bool dumpTrace(const std::string &path) const;
+
+private:
+	static const size_t FRAME_CAPACITY = 240;
+	static const size_t EVENT_CAPACITY = 1 << 15; // power of two
+
+	struct Event {
+		std::atomic<uint64_t> sequence { 0 }; // index + 1 once the slot is complete, 0 while written
+		std::atomic<int>      stage { 0 };
+		std::atomic<int>      thread { 0 };
+		std::atomic<uint64_t> start { 0 };
+		std::atomic<uint64_t> end { 0 };
+	};
+
+	std::array<std::atomic<uint64_t>, STAGE_COUNT> stageMicros {};
+
+	std::array<FrameSample, FRAME_CAPACITY> frames {};
+	size_t                                  frameHead    = 0;
+	uint64_t                                lastFrameEnd = 0;
+
+	std::unique_ptr<Event[]> events { new Event[EVENT_CAPACITY] };
+	std::atomic<uint64_t>    eventHead { 0 };
+
+	bool  bEnabled = false;
+	float budgetMs = 1000.0f / 120.0f;
+
+	static int threadIndex() {
+		static std::atomic<int> nextIndex { 0 };
+		thread_local int        index = nextIndex++;
+		return index;
+	}
+};
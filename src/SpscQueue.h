@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free FIFO for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two. push() never blocks and fails when the queue is full,
+// pop() fails when it is empty. Head and tail live on separate cache lines so the two sides
+// do not invalidate each other on every operation.
+template <typename T, size_t Capacity>
+class SpscQueue {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	// producer side ----------------------------------------------------------------------
+	bool push(T value) {
+		size_t tail = writeIndex.load(std::memory_order_relaxed);
+		if (tail - readIndex.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		slots[tail & (Capacity - 1)] = std::move(value);
+		writeIndex.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side ----------------------------------------------------------------------
+	bool pop(T &value) {
+		size_t head = readIndex.load(std::memory_order_relaxed);
+		if (head == writeIndex.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = std::move(slots[head & (Capacity - 1)]);
+		readIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// exact on either end, a snapshot from anywhere else
+	size_t size() const {
+		size_t head = readIndex.load(std::memory_order_acquire);
+		size_t tail = writeIndex.load(std::memory_order_acquire);
+		return tail - head;
+	}
+
+	static constexpr size_t capacity() {
+		return Capacity;
+	}
+
+private:
+	T slots[Capacity];
+
+	alignas(64) std::atomic<size_t> writeIndex { 0 };
+	alignas(64) std::atomic<size_t> readIndex { 0 };
+};
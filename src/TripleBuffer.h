@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free latest-value slot for exactly one writer thread and one reader thread.
+// The writer fills getWriteBuffer() and publish()es it, the reader calls update() and
+// then read()s the newest complete value. Neither side ever blocks; a value that is
+// overwritten before the reader picks it up is dropped (publish() reports it).
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : state(pack(1, false)), front(0), back(2) {
+	}
+
+	// writer side ------------------------------------------------------------------------
+	T &getWriteBuffer() {
+		return buffers[back];
+	}
+
+	// returns true when the previously published value was never read
+	bool publish() {
+		uint8_t prev = state.exchange(pack(back, true), std::memory_order_acq_rel);
+		back         = slot(prev);
+		return fresh(prev);
+	}
+
+	// reader side ------------------------------------------------------------------------
+	// swaps in the newest published value, returns false when nothing new arrived
+	bool update() {
+		if (!hasPending()) {
+			return false;
+		}
+		uint8_t prev = state.exchange(pack(front, false), std::memory_order_acq_rel);
+		front        = slot(prev);
+		return true;
+	}
+
+	bool hasPending() const {
+		return fresh(state.load(std::memory_order_acquire));
+	}
+
+	const T &read() const {
+		return buffers[front];
+	}
+
+	T &getReadBuffer() {
+		return buffers[front];
+	}
+
+private:
+	T buffers[3];
+
+	// bits 0-1: index of the shared middle slot, bit 2: middle slot holds an unread value
+	std::atomic<uint8_t> state;
+	uint8_t              front;
+	uint8_t              back;
+
+	static uint8_t pack(uint8_t index, bool isFresh) {
+		return index | (isFresh ? 4 : 0);
+	}
+
+	static uint8_t slot(uint8_t s) {
+		return s & 3;
+	}
+
+	static bool fresh(uint8_t s) {
+		return (s & 4) != 0;
+	}
+};
@@ -10,6 +10,22 @@ void UIManager::setup() {
 
 	gui.add(asciiOffset_s.setup("asciiOffset", 0, 0, 128));
 	gui.add(asciiMix_s.setup("asciiMix", 0.5f, 0.0f, 1.4f));
+
+	gui.add(gpuParticles_t.setup("GPU particles", false));
+	gui.add(lod_t.setup("Auto LOD", true));
+	gui.add(budget_s.setup("Budget ms", 1000.0f / 120.0f, 2.0f, 33.0f));
+	gui.add(lod_l.setup("LOD", ""));
+	gui.add(flowBackend_s.setup("Flow backend", 0, 0, 2));
+	gui.add(disPreset_s.setup("DIS preset", 0, 0, 2));
+	gui.add(flowLevels_s.setup("Flow levels", 4, 1, 6));
+	gui.add(flowWinSize_s.setup("Flow window", 4, 3, 21));
+	gui.add(flowGridStep_s.setup("Sparse grid step", 4, 2, 16));
+	gui.add(flowBand_s.setup("Sparse band", 0.25f, 0.05f, 0.5f));
+	gui.add(lkLevels_s.setup("Sparse levels", 2, 0, 4));
+	gui.add(lkWinSize_s.setup("Sparse window", 9, 3, 31));
+	gui.add(flow_l.setup("Flow", ""));
+	gui.add(profiler_t.setup("Profiler", false));
+	gui.add(traceDump_b.setup("Dump trace"));
 }
 
 void UIManager::draw() {
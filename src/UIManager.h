@@ -17,4 +17,22 @@ public:
 	ofxIntSlider spread_s;
 	ofxIntSlider asciiOffset_s;
 	ofxFloatSlider asciiMix_s;
+
+	ofxToggle      gpuParticles_t;
+	ofxToggle      lod_t;
+	ofxFloatSlider budget_s;
+	ofxLabel       lod_l;
+
+	ofxIntSlider   flowBackend_s;
+	ofxIntSlider   disPreset_s;
+	ofxIntSlider   flowLevels_s;
+	ofxIntSlider   flowWinSize_s;
+	ofxIntSlider   flowGridStep_s;
+	ofxFloatSlider flowBand_s;
+	ofxIntSlider   lkLevels_s;
+	ofxIntSlider   lkWinSize_s;
+	ofxLabel       flow_l;
+
+	ofxToggle profiler_t;
+	ofxButton traceDump_b;
 };
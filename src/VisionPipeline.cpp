@@ -0,0 +1,212 @@
+#include "VisionPipeline.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VISION_SSE
+#endif
+
+void VisionPipeline::setup(int sourceWidth, int sourceHeight, bool useTexture) {
+	this->sourceWidth  = sourceWidth;
+	this->sourceHeight = sourceHeight;
+
+	// headless runs have no GL context to upload into
+	currentImage.setUseTexture(useTexture);
+}
+
+bool VisionPipeline::allocate() {
+	int scaledWidth  = sourceWidth / settings.cvDownScale;
+	int scaledHeight = sourceHeight / settings.cvDownScale;
+
+	if (currentImage.getWidth() == scaledWidth && currentImage.getHeight() == scaledHeight) {
+		return false;
+	}
+
+	previousMat = cv::Mat(scaledHeight, scaledWidth, CV_8UC1);
+	flowMat     = cv::Mat(scaledHeight, scaledWidth, CV_32FC2);
+	// currentImage.clear();
+	currentImage.allocate(scaledWidth, scaledHeight);
+	currentImage.set(0);
+	previousMat.release();
+	currentImage.getCvMat().copyTo(previousMat);
+	flowMat.release();
+	flowMat = cv::Mat(scaledHeight, scaledWidth, CV_32FC2);
+	return true;
+}
+
+void VisionPipeline::processFrame(const ofPixels &pixels) {
+	int channels = pixels.getNumChannels();
+	if (!pixels.isAllocated() || !currentImage.bAllocated || (channels != 1 && channels != 3 && channels != 4)) {
+		return;
+	}
+
+	cv::Mat gray = currentImage.getCvMat(); // shares the image's buffer, written in place
+	downscaleLuma(pixels, gray);
+	copiedBytes = gray.total();
+
+	if (settings.bContrastStretch) {
+		contrastStretch(gray);
+	}
+
+	// OpenCV's fixed point u8 Gaussian is already vectorized, and at this size it is cheap
+	if (settings.blurAmount > 0) {
+		int kernel = settings.blurAmount | 1;
+		cv::GaussianBlur(gray, gray, cv::Size(kernel, kernel), 0);
+	}
+
+	currentImage.flagImageChanged();
+	bFrameProcessed = true;
+}
+
+void VisionPipeline::processFrameReference(const ofPixels &pixels) {
+	int channels = pixels.getNumChannels();
+	if (!pixels.isAllocated() || !currentImage.bAllocated || (channels != 1 && channels != 3 && channels != 4)) {
+		return;
+	}
+
+	// non-owning view of the camera buffer
+	cv::Mat frame(pixels.getHeight(), pixels.getWidth(), CV_8UC(channels), (void *)pixels.getData(),
+	              pixels.getBytesStride());
+	cv::Mat gray = currentImage.getCvMat();
+
+	if (channels == 1) {
+		cv::resize(frame, gray, gray.size(), 0, 0, cv::INTER_AREA);
+		copiedBytes = gray.total();
+	} else {
+		bool bgr = pixels.getPixelFormat() == OF_PIXELS_BGR || pixels.getPixelFormat() == OF_PIXELS_BGRA;
+		int  code;
+		if (channels == 4) {
+			code = bgr ? cv::COLOR_BGRA2GRAY : cv::COLOR_RGBA2GRAY;
+		} else {
+			code = bgr ? cv::COLOR_BGR2GRAY : cv::COLOR_RGB2GRAY;
+		}
+		cv::resize(frame, scaledColor, gray.size(), 0, 0, cv::INTER_AREA);
+		cv::cvtColor(scaledColor, gray, code);
+		copiedBytes = scaledColor.total() * scaledColor.elemSize() + gray.total();
+	}
+
+	if (settings.bMirror) {
+		cv::flip(gray, gray, 1);
+		copiedBytes += gray.total();
+	}
+	currentImage.flagImageChanged();
+	bFrameProcessed = true;
+
+	if (settings.bContrastStretch)
+		currentImage.contrastStretch();
+
+	if (settings.blurAmount > 0)
+		currentImage.blurGaussian(settings.blurAmount);
+}
+
+// One pass over the camera buffer. Every output pixel averages the source pixels of its box
+// (the integer bounds an area resize uses for integer ratios) as separate R, G, B sums; luma of
+// the sums with cvtColor's fixed point weights is luma of the average without rounding the
+// averaged color first. The result goes straight to its mirrored column.
+void VisionPipeline::downscaleLuma(const ofPixels &pixels, cv::Mat &gray) {
+	const int      sourceColumns = pixels.getWidth();
+	const int      sourceRows    = pixels.getHeight();
+	const int      channels      = pixels.getNumChannels();
+	const size_t   stride        = pixels.getBytesStride();
+	const uint8_t *data          = pixels.getData();
+	const int      columns       = gray.cols;
+	const int      rows          = gray.rows;
+
+	// channel offsets, gray input reads the same byte three times
+	bool bgr = pixels.getPixelFormat() == OF_PIXELS_BGR || pixels.getPixelFormat() == OF_PIXELS_BGRA;
+	int  r   = channels == 1 ? 0 : (bgr ? 2 : 0);
+	int  g   = channels == 1 ? 0 : 1;
+	int  b   = channels == 1 ? 0 : (bgr ? 0 : 2);
+
+	columnStart.resize(columns + 1);
+	for (int x = 0; x <= columns; x++) {
+		columnStart[x] = (int)((int64_t)x * sourceColumns / columns);
+	}
+	boxSums.resize(columns * 3);
+
+	for (int y = 0; y < rows; y++) {
+		int rowBegin = (int)((int64_t)y * sourceRows / rows);
+		int rowEnd   = (int)((int64_t)(y + 1) * sourceRows / rows);
+		std::fill(boxSums.begin(), boxSums.end(), 0);
+
+		for (int sy = rowBegin; sy < rowEnd; sy++) {
+			const uint8_t *row = data + sy * stride;
+			uint32_t      *sum = boxSums.data();
+			for (int x = 0; x < columns; x++, sum += 3) {
+				const uint8_t *p   = row + columnStart[x] * channels;
+				const uint8_t *end = row + columnStart[x + 1] * channels;
+				uint32_t       sr = 0, sg = 0, sb = 0;
+				for (; p < end; p += channels) {
+					sr += p[r];
+					sg += p[g];
+					sb += p[b];
+				}
+				sum[0] += sr;
+				sum[1] += sg;
+				sum[2] += sb;
+			}
+		}
+
+		uint8_t *out = gray.ptr<uint8_t>(y);
+		for (int x = 0; x < columns; x++) {
+			// cvtColor weights, they add up to 1 << 14
+			uint64_t count  = (uint64_t)(columnStart[x + 1] - columnStart[x]) * (rowEnd - rowBegin) << 14;
+			uint64_t luma   = (uint64_t)boxSums[x * 3] * 4899 + (uint64_t)boxSums[x * 3 + 1] * 9617
+			                + (uint64_t)boxSums[x * 3 + 2] * 1868;
+			int      column = settings.bMirror ? columns - 1 - x : x;
+			out[column]     = count > 0 ? (uint8_t)((luma + count / 2) / count) : 0;
+		}
+	}
+}
+
+// ofxCvGrayscaleImage::contrastStretch() without its two full passes of cvMinMaxLoc and
+// cvConvertScale: min / max in 16 byte steps, then the same float mapping through a table
+void VisionPipeline::contrastStretch(cv::Mat &gray) {
+	uint8_t lo = 255, hi = 0;
+	for (int y = 0; y < gray.rows; y++) {
+		const uint8_t *row = gray.ptr<uint8_t>(y);
+		int            x   = 0;
+#ifdef VISION_SSE
+		__m128i minimum = _mm_set1_epi8((char)255);
+		__m128i maximum = _mm_setzero_si128();
+		for (; x + 16 <= gray.cols; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+			minimum   = _mm_min_epu8(minimum, v);
+			maximum   = _mm_max_epu8(maximum, v);
+		}
+		alignas(16) uint8_t lanes[2][16];
+		_mm_store_si128((__m128i *)lanes[0], minimum);
+		_mm_store_si128((__m128i *)lanes[1], maximum);
+		for (int k = 0; k < 16; k++) {
+			lo = std::min(lo, lanes[0][k]);
+			hi = std::max(hi, lanes[1][k]);
+		}
+#endif
+		for (; x < gray.cols; x++) {
+			lo = std::min(lo, row[x]);
+			hi = std::max(hi, row[x]);
+		}
+	}
+	if (hi <= lo) {
+		return;
+	}
+
+	float scale = 255.0f / (hi - lo);
+	float shift = -(lo * scale);
+	for (int v = 0; v < 256; v++) {
+		stretchTable[v] = cv::saturate_cast<uint8_t>(v * scale + shift);
+	}
+	for (int y = 0; y < gray.rows; y++) {
+		uint8_t *row = gray.ptr<uint8_t>(y);
+		for (int x = 0; x < gray.cols; x++) {
+			row[x] = stretchTable[row[x]];
+		}
+	}
+}
+
+void VisionPipeline::calculateOpticalFlow() {
+	cv::Mat currentMat = currentImage.getCvMat();
+	flowEngine.calculate(previousMat, currentMat, flowMat);
+
+	currentMat.copyTo(previousMat);
+	copiedBytes += previousMat.total();
+}
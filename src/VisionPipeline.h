@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FlowEngine.h"
+#include "ofMain.h"
+#include "ofxOpenCv.h"
+
+#include <array>
+
+// The camera-side stages of a frame: downscale, gray conversion, mirror, contrast stretch, blur
+// and optical flow (backend chosen in flowEngine.settings). One fused pass reads the camera
+// pixels and writes the mirrored, box-averaged luma image; contrast stretch and blur only see
+// the small image. processFrameReference() is the OpenCV chain it replaced, kept for
+// comparisons. Kept free of windowing and drawing so the benchmark harness can run it headless.
+class VisionPipeline {
+public:
+	struct Settings {
+		float cvDownScale      = 16;
+		bool  bMirror          = true;
+		bool  bContrastStretch = true;
+		int   blurAmount       = 3;
+	};
+
+	Settings settings;
+
+	ofxCvGrayscaleImage currentImage;
+
+	cv::Mat previousMat;
+	cv::Mat flowMat;
+
+	FlowEngine flowEngine;
+
+	void setup(int sourceWidth, int sourceHeight, bool useTexture = true);
+
+	// (re)allocates the downscaled buffers when cvDownScale changed, returns true if it did
+	bool allocate();
+
+	void processFrame(const ofPixels &pixels);
+	// INTER_AREA resize, cvtColor, flip and the ofxCvImage filters, same output within rounding
+	void processFrameReference(const ofPixels &pixels);
+	void calculateOpticalFlow();
+
+	bool isReady() const {
+		return bFrameProcessed;
+	}
+
+	// image bytes written by copies and conversions (not the in-place filters) for the last frame
+	size_t getCopiedBytes() const {
+		return copiedBytes;
+	}
+
+	int getSourceWidth() const {
+		return sourceWidth;
+	}
+
+	int getSourceHeight() const {
+		return sourceHeight;
+	}
+
+private:
+	int sourceWidth  = 0;
+	int sourceHeight = 0;
+
+	cv::Mat scaledColor; // camera color at the downscaled size, reference path only
+	bool    bFrameProcessed = false;
+	size_t  copiedBytes     = 0;
+
+	std::vector<int>         columnStart; // first camera column of every output column
+	std::vector<uint32_t>    boxSums;     // R, G, B per output column for the current output row
+	std::array<uint8_t, 256> stretchTable;
+
+	void downscaleLuma(const ofPixels &pixels, cv::Mat &gray);
+	void contrastStretch(cv::Mat &gray);
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "Profiler.h"
+#include "TripleBuffer.h"
+#include "VisionPipeline.h"
+#include "ofMain.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Runs the VisionPipeline (gray, mirror, downscale, contrast stretch, blur, optical flow) on its
+// own thread. The frame source stays on the render thread, which submit()s every new camera
+// frame together with the settings to process it with; the worker always takes the newest
+// frame (frames it could not get to are dropped, never queued) and publishes the camera pixels
+// with their flow field through a TripleBuffer. update() swaps in the newest result without
+// waiting, so capture and vision of the next frame overlap with rendering of this one.
+class VisionWorker {
+public:
+	// one processed frame, read() on the render thread
+	struct Output {
+		ofPixels            pixels; // camera color, as submitted
+		cv::Mat             flow;   // CV_32FC2 at the downscaled size
+		bool                bMirror       = true;
+		FlowEngine::Backend backend       = FlowEngine::BACKEND_FARNEBACK;
+		float               flowAverageMs = 0.0f;
+		uint64_t            frameNum      = 0;
+		uint64_t            captureMicros = 0;
+		uint64_t            doneMicros    = 0;
+		uint64_t            flowMicros    = 0; // capture time between the two frames of flow, 0 for the first
+	};
+
+	struct Stats {
+		uint64_t submitted   = 0;
+		uint64_t dropped     = 0; // frames replaced before the worker could take them
+		uint64_t processed   = 0;
+		uint64_t skipped     = 0; // results replaced before the render thread showed them
+		int      inputDepth  = 0; // frames waiting for the worker, 0 or 1
+		int      inFlight    = 0; // frames being processed, 0 or 1
+		int      outputDepth = 0; // results waiting for the render thread, 0 or 1
+		float    processMs   = 0.0f; // gray .. blur, smoothed
+		float    flowMs      = 0.0f; // smoothed
+		float    pipelineMs  = 0.0f; // capture -> result published, smoothed
+		float    toPhotonMs  = 0.0f; // capture -> end of the first draw showing it, smoothed
+		size_t   copiedBytes = 0;    // per frame: the copy into submit() + the pipeline's copies
+	};
+
+	// render thread settings, copied into every submitted frame
+	VisionPipeline::Settings settings;
+	FlowEngine::Settings     flowSettings;
+
+	~VisionWorker() {
+		stop();
+	}
+
+	// before start()
+	void setup(int sourceWidth, int sourceHeight) {
+		// no GL context on the worker, nothing is uploaded
+		pipeline.setup(sourceWidth, sourceHeight, false);
+	}
+
+	void start() {
+		if (running) {
+			return;
+		}
+		running = true;
+		thread  = std::thread(&VisionWorker::run, this);
+	}
+
+	void stop() {
+		running = false;
+		wake.notify_all();
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// render thread ----------------------------------------------------------------------
+	void submit(const ofPixels &pixels, uint64_t frameNum) {
+		Frame &slot        = frames.getWriteBuffer();
+		slot.pixels        = pixels; // the one full-size copy, same size every frame so the slot is reused
+		slot.frameNum      = frameNum;
+		slot.captureMicros = ofGetElapsedTimeMicros();
+		slot.settings      = settings;
+		slot.flowSettings  = flowSettings;
+
+		if (frames.publish()) {
+			dropped++;
+		}
+		submitted++;
+		wake.notify_one();
+	}
+
+	// swaps in the newest result, returns true if it changed
+	bool update() {
+		if (!outputs.update()) {
+			return false;
+		}
+		bPresented = false;
+		return true;
+	}
+
+	// valid until the next update()
+	const Output &read() const {
+		return outputs.read();
+	}
+
+	bool isReady() const {
+		return read().pixels.isAllocated() && !read().flow.empty();
+	}
+
+	// call at the end of draw(); the first draw of a result closes its capture-to-photon time.
+	// Swap and scanout come on top, they are not visible from here.
+	void presented() {
+		if (bPresented || read().captureMicros == 0) {
+			return;
+		}
+		bPresented = true;
+		toPhotonMs = smooth(toPhotonMs, (ofGetElapsedTimeMicros() - read().captureMicros) / 1000.0f);
+	}
+
+	Stats getStats() const {
+		Stats s;
+		s.submitted   = submitted;
+		s.dropped     = dropped;
+		s.processed   = processed;
+		s.skipped     = skipped;
+		s.inputDepth  = frames.hasPending() ? 1 : 0;
+		s.inFlight    = busy ? 1 : 0;
+		s.outputDepth = outputs.hasPending() ? 1 : 0;
+		s.processMs   = processMs;
+		s.flowMs      = flowMs;
+		s.pipelineMs  = pipelineMs;
+		s.toPhotonMs  = toPhotonMs;
+		s.copiedBytes = copiedBytes;
+		return s;
+	}
+
+private:
+	struct Frame {
+		ofPixels                 pixels;
+		uint64_t                 frameNum      = 0;
+		uint64_t                 captureMicros = 0;
+		VisionPipeline::Settings settings;
+		FlowEngine::Settings     flowSettings;
+	};
+
+	VisionPipeline pipeline; // worker thread only, after setup()
+
+	TripleBuffer<Frame>  frames;  // render -> worker
+	TripleBuffer<Output> outputs; // worker -> render
+
+	std::thread             thread;
+	std::atomic<bool>       running { false };
+	std::mutex              wakeMutex;
+	std::condition_variable wake;
+
+	std::atomic<uint64_t> submitted { 0 };
+	std::atomic<uint64_t> dropped { 0 };
+	std::atomic<uint64_t> processed { 0 };
+	std::atomic<uint64_t> skipped { 0 };
+	std::atomic<bool>     busy { false };
+	std::atomic<float>    processMs { 0.0f };
+	std::atomic<float>    flowMs { 0.0f };
+	std::atomic<float>    pipelineMs { 0.0f };
+	std::atomic<size_t>   copiedBytes { 0 };
+
+	// worker thread only
+	uint64_t previousCaptureMicros = 0;
+
+	// render thread only
+	bool  bPresented = true;
+	float toPhotonMs = 0.0f;
+
+	static float smooth(float average, float ms) {
+		return average == 0.0f ? ms : ofLerp(average, ms, 0.1f);
+	}
+
+	void run() {
+		while (running) {
+			{
+				// the timeout only guards against a missed notify, publication itself is lock-free
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return frames.hasPending() || !running; });
+			}
+
+			if (!running || !frames.update()) {
+				continue;
+			}
+
+			Frame &frame = frames.getReadBuffer();
+			if (!frame.pixels.isAllocated()) {
+				continue;
+			}
+			busy = true;
+
+			pipeline.settings            = frame.settings;
+			pipeline.flowEngine.settings = frame.flowSettings;
+			pipeline.allocate();
+
+			uint64_t t0 = Profiler::now();
+			{
+				Profiler::Scope scope(Profiler::STAGE_GRAY);
+				pipeline.processFrame(frame.pixels);
+			}
+			uint64_t t1 = Profiler::now();
+			{
+				Profiler::Scope scope(Profiler::STAGE_FLOW);
+				pipeline.calculateOpticalFlow();
+			}
+			uint64_t t2 = Profiler::now();
+
+			// the frame slot is the worker's until the next frames.update(), so the camera pixels
+			// move to the output instead of being copied; both slots keep their allocation
+			copiedBytes = frame.pixels.getTotalBytes() + pipeline.getCopiedBytes();
+
+			Output &out = outputs.getWriteBuffer();
+			out.pixels.swap(frame.pixels);
+			pipeline.flowMat.copyTo(out.flow);
+			out.bMirror       = frame.settings.bMirror;
+			out.backend       = pipeline.flowEngine.getActiveBackend();
+			out.flowAverageMs = pipeline.flowEngine.getAverageMs(out.backend);
+			out.frameNum      = frame.frameNum;
+			out.captureMicros = frame.captureMicros;
+			out.doneMicros    = ofGetElapsedTimeMicros();
+			out.flowMicros    = previousCaptureMicros > 0 ? frame.captureMicros - previousCaptureMicros : 0;
+
+			previousCaptureMicros = frame.captureMicros;
+
+			processMs  = smooth(processMs, (t1 - t0) / 1000.0f);
+			flowMs     = smooth(flowMs, (t2 - t1) / 1000.0f);
+			pipelineMs = smooth(pipelineMs, (out.doneMicros - out.captureMicros) / 1000.0f);
+
+			// out belongs to the render thread from here on
+			if (outputs.publish()) {
+				skipped++;
+			}
+			processed++;
+			busy = false;
+		}
+	}
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for data-parallel loops. parallelFor(jobs, fn) calls fn(0 .. jobs - 1)
+// spread over the workers and the calling thread, and returns when every job has run.
+// Threads are started once by setThreadCount() and sleep between calls, so a per-frame
+// loop does not pay for thread creation. Jobs are handed out dynamically; anything that
+// has to be deterministic must write per-job results and merge them in job order.
+class WorkerPool {
+public:
+	explicit WorkerPool(int threads = 1) {
+		setThreadCount(threads);
+	}
+
+	~WorkerPool() {
+		stopThreads();
+	}
+
+	WorkerPool(const WorkerPool &)            = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	// total threads including the caller, 0 uses every hardware thread
+	void setThreadCount(int threads) {
+		if (threads <= 0) {
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		if (threads == getThreadCount()) {
+			return;
+		}
+
+		stopThreads();
+		bStop = false;
+		for (int i = 1; i < threads; i++) {
+			workers.emplace_back([this] { workerLoop(); });
+		}
+	}
+
+	int getThreadCount() const {
+		return workers.size() + 1;
+	}
+
+	template <typename F>
+	void parallelFor(size_t jobs, F &&fn) {
+		if (workers.empty() || jobs <= 1) {
+			for (size_t i = 0; i < jobs; i++) {
+				fn(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task     = &fn;
+			invoke   = [](void *f, size_t i) { (*static_cast<F *>(f))(i); };
+			jobCount = jobs;
+			nextJob.store(0, std::memory_order_relaxed);
+			finished = 0;
+			generation++;
+		}
+		wake.notify_all();
+
+		runJobs();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return finished == workers.size(); });
+		task = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex              mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	uint64_t                generation = 0;
+	size_t                  finished   = 0;
+	bool                    bStop      = false;
+
+	// current loop, valid while parallelFor() is waiting
+	void *task                     = nullptr;
+	void (*invoke)(void *, size_t) = nullptr;
+	size_t              jobCount   = 0;
+	std::atomic<size_t> nextJob { 0 };
+
+	void runJobs() {
+		for (size_t i = nextJob.fetch_add(1); i < jobCount; i = nextJob.fetch_add(1)) {
+			invoke(task, i);
+		}
+	}
+
+	void workerLoop() {
+		uint64_t seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return bStop || generation != seen; });
+				if (bStop) {
+					return;
+				}
+				seen = generation;
+			}
+
+			runJobs();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished++;
+			}
+			done.notify_one();
+		}
+	}
+
+	void stopThreads() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			bStop = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : workers) {
+			t.join();
+		}
+		workers.clear();
+	}
+};
@@ -1,9 +1,90 @@
+#include "BenchmarkApp.h"
 #include "ofApp.h"
+#include "ofAppNoWindow.h"
 #include "ofMain.h"
 #include "ofWindowSettings.h"
 
 //========================================================================
-int main() {
+// --source camera|synthetic|<video file>|<image directory>   --freerun   --threads N   --gpu-particles
+// --flow farneback|dis|sparse   --control ws://host:port/path|none   --serve PORT
+// --bench [--frames N] [--spacings 2,4,8] [--downscales 4,8,16] [--out results.json]
+int main(int argc, char *argv[]) {
+	std::string sourceSpec = "camera";
+	bool        bFreeRun   = false;
+	bool        bBench     = false;
+	int         threads    = 0;
+	bool        bGpu       = false;
+
+	FlowEngine::Backend flow = FlowEngine::BACKEND_FARNEBACK;
+
+	std::string controlUri  = "ws://ws.42ls.online/of-ws";
+	int         controlPort = 0;
+
+	BenchmarkApp::Settings bench;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		bool        more = i + 1 < argc;
+		if (arg == "--source" && more) {
+			sourceSpec = argv[++i];
+		} else if (arg == "--freerun") {
+			bFreeRun = true;
+		} else if (arg == "--threads" && more) {
+			threads = ofToInt(argv[++i]);
+		} else if (arg == "--gpu-particles") {
+			bGpu = true;
+		} else if (arg == "--flow" && more) {
+			if (!FlowEngine::parseBackend(argv[++i], flow)) {
+				ofLogError("main") << "unknown flow backend " << argv[i] << ", using " << FlowEngine::backendName(flow);
+			}
+		} else if (arg == "--control" && more) {
+			controlUri = argv[++i];
+			if (controlUri == "none") {
+				controlUri.clear();
+			}
+		} else if (arg == "--serve" && more) {
+			controlPort = ofToInt(argv[++i]);
+		} else if (arg == "--bench") {
+			bBench = true;
+		} else if (arg == "--frames" && more) {
+			bench.frames = ofToInt(argv[++i]);
+		} else if (arg == "--out" && more) {
+			bench.outputPath = argv[++i];
+		} else if (arg == "--spacings" && more) {
+			bench.spacings.clear();
+			for (auto &v : ofSplitString(argv[++i], ",", true, true)) {
+				bench.spacings.push_back(ofToInt(v));
+			}
+		} else if (arg == "--downscales" && more) {
+			bench.downScales.clear();
+			for (auto &v : ofSplitString(argv[++i], ",", true, true)) {
+				bench.downScales.push_back(ofToFloat(v));
+			}
+		}
+	}
+
+	if (bBench) {
+		// no window and no GL context, the pipeline stages run on plain pixels
+		if (sourceSpec != "camera") {
+			bench.sourceSpec = sourceSpec;
+		}
+		bench.threads     = threads;
+		bench.flowBackend = flow;
+		auto window = std::make_shared<ofAppNoWindow>();
+		ofSetupOpenGL(window, 1280, 720, OF_WINDOW);
+		ofRunApp(new BenchmarkApp(bench));
+		return 0;
+	}
+
 	ofSetupOpenGL(1920, 1200, OF_FULLSCREEN); // <-------- setup the GL context
-	ofRunApp(new ofApp());
+
+	ofApp *app           = new ofApp();
+	app->sourceSpec      = sourceSpec;
+	app->bFreeRun        = bFreeRun;
+	app->particleThreads = threads;
+	app->bGpuParticles   = bGpu;
+	app->flowBackend     = flow;
+	app->controlUri      = controlUri;
+	app->controlPort     = controlPort;
+	ofRunApp(app);
 }
@@ -27,10 +27,11 @@ void ofApp::setup() {
 	particle_size    = 8.0f;
 	spacing          = 4.0f;
 	flowSensitivity  = 0.40f;
-	blurAmount       = 3;
-	bMirror          = true;
-	cvDownScale      = 16;
-	bContrastStretch = true;
+	vision.settings.blurAmount       = 3;
+	vision.settings.bMirror          = true;
+	vision.settings.cvDownScale      = 16;
+	vision.settings.bContrastStretch = true;
+	vision.flowSettings.backend      = flowBackend;
 
 	// store a minimum squared value to apply flow velocity
 	minLengthSquared = 0.7 * 0.7; // 0.5 pixel squared
@@ -49,15 +50,29 @@ void ofApp::setup() {
 	font.setLineHeight(28.0);
 	font.setLetterSpacing(1.05);
 
-	cam.setDesiredFrameRate(60);
-	cam.setup(1280, 720);
+	source = FrameSource::create(sourceSpec);
+	source->setFrameRate(60);
+	source->setFreeRun(bFreeRun);
+	if (!source->setup(1280, 720)) {
+		ofLogError("ofApp") << "Frame source " << source->getName() << " failed, falling back to synthetic frames";
+		source = FrameSource::create("synthetic");
+		source->setFreeRun(bFreeRun);
+		source->setup(1280, 720);
+	}
+
+	if (bFreeRun) {
+		// measure pipeline throughput instead of holding 120 FPS
+		ofSetFrameRate(0);
+	}
 
-	sourceWidth  = cam.getWidth();
-	sourceHeight = cam.getHeight();
+	sourceWidth  = source->getWidth();
+	sourceHeight = source->getHeight();
 
-	depthOrig.allocate(sourceWidth, sourceHeight);
-	depthProcessed.allocate(sourceWidth, sourceHeight);
-	colorImg.allocate(sourceWidth, sourceHeight);
+	vision.setup(sourceWidth, sourceHeight);
+	vision.start();
+
+	particleSystem.setThreadCount(particleThreads);
+	ofLogNotice("ofApp") << "Particle update on " << particleSystem.getThreadCount() << " threads";
 
 	// Setup post-processing chain
 	post.init(WIN_W, WIN_H);
@@ -81,8 +96,14 @@ void ofApp::setup() {
 	uiManager.asciiOffset_s.addListener(this, &ofApp::asciiOffsetChanged);
 	uiManager.asciiMix_s.addListener(this, &ofApp::asciiMixChanged);
 
+	uiManager.traceDump_b.addListener(this, &ofApp::dumpTrace);
+	uiManager.gpuParticles_t.addListener(this, &ofApp::gpuParticlesChanged);
+
 	uiManager.setup();
+	uiManager.gpuParticles_t = bGpuParticles;
+	uiManager.flowBackend_s  = flowBackend;
 #endif
+	useGpuParticles(); // --gpu-particles on hardware without it
 
 	zoomBlur->setExposure(0.25);
 	zoomBlur->setWeight(0.6);
@@ -104,49 +125,77 @@ void ofApp::setup() {
 
 	// WEBSOCKET communication with fastAPI server
 	webSocket.onMessage = [&](const std::string &msg) { ofLogNotice() << "Received: " << msg; };
-	webSocket.connect("ws://ws.42ls.online/of-ws");
-
-	sliderHandlers = {
-		{ "slider_0",
-		  [this](float val) {
-		      spacing = scaleParameter(val, 128.0f, 10.0f);
-		      spacing = ofClamp(spacing, 10.0f, 128.0f);
-		      generateParticles(WIN_W, WIN_H);
-		  } },
-		{ "slider_1", [this](float val) { particle_size = scaleParameter(val, 15.0f, 1.0f); } },
-		{ "slider_2", [this](float val) { zoomBlur->setWeight(scaleParameter(val, 1.5f, 0.5)); } },
-		{ "slider_3", [this](float val) { zoomBlur->setDecay(scaleParameter(val, 0.9f)); } },
-		{ "slider_4", [this](float val) { zoomBlur->setExposure(scaleParameter(val, 1.0f)); } },
-		{ "slider_5", [this](float val) { zoomBlur->setDensity(scaleParameter(val, 0.1f)); } },
-		{ "slider_6", [this](float val) { s_asciiFontScale     = scaleParameter(val, 120.0f, 1.0); } },
-		{ "slider_7", [this](float val) { s_asciiCharsetOffset = scaleParameter(val, 64.0); } },
-		{ "slider_8", [this](float val) { s_asciiMix           = scaleParameter(val, 1.0f); } },
-		{ "slider_9", [this](float val) { loadTextureFromFile(floor((val / 1000.0f) * maps_count)); } },
-	};
+	// the panel is served from the repository root, two levels above bin/data
+	if (controlPort > 0) {
+		webSocket.listen(controlPort, ofToDataPath("../../index.html", true));
+	} else if (!controlUri.empty()) {
+		webSocket.connect(controlUri);
+	}
 
-	togglesHandlers = {
-		{ "toggle_0", [this](int val) { val == 1 ? b_Ascii = true : b_Ascii = false; } },
-		{ "toggle_1", [this](int val) { zoomBlur->setEnabled(val); } },
-		{ "toggle_2", [this](int val) { edgePass->setEnabled(val); } },
-		{ "toggle_3", [this](int val) { post[0]->setEnabled(val); } },
+	// indexed by ControlProtocol id, so JSON and binary messages take the same path
+	using ControlProtocol::slider;
+	using ControlProtocol::toggle;
+	controlHandlers[slider(0)] = [this](float val) {
+		int newSpacing = ofClamp(scaleParameter(val, 128.0f, 10.0f), 10.0f, 128.0f);
+		if (newSpacing != spacing) {
+			spacing         = newSpacing;
+			bParticlesDirty = true;
+		}
 	};
-
-	classify.setup("yolov5n.onnx", "classes.txt", true);
+	controlHandlers[slider(1)] = [this](float val) { particle_size = scaleParameter(val, 15.0f, 1.0f); };
+	controlHandlers[slider(2)] = [this](float val) { zoomBlur->setWeight(scaleParameter(val, 1.5f, 0.5)); };
+	controlHandlers[slider(3)] = [this](float val) { zoomBlur->setDecay(scaleParameter(val, 0.9f)); };
+	controlHandlers[slider(4)] = [this](float val) { zoomBlur->setExposure(scaleParameter(val, 1.0f)); };
+	controlHandlers[slider(5)] = [this](float val) { zoomBlur->setDensity(scaleParameter(val, 0.1f)); };
+	controlHandlers[slider(6)] = [this](float val) { s_asciiFontScale = scaleParameter(val, 120.0f, 1.0); };
+	controlHandlers[slider(7)] = [this](float val) { s_asciiCharsetOffset = scaleParameter(val, 64.0); };
+	controlHandlers[slider(8)] = [this](float val) { s_asciiMix = scaleParameter(val, 1.0f); };
+	controlHandlers[slider(9)] = [this](float val) { loadTextureFromFile(floor((val / 1000.0f) * maps_count)); };
+
+	controlHandlers[toggle(0)] = [this](int val) { val == 1 ? b_Ascii = true : b_Ascii = false; };
+	controlHandlers[toggle(1)] = [this](int val) { zoomBlur->setEnabled(val); };
+	controlHandlers[toggle(2)] = [this](int val) { edgePass->setEnabled(val); };
+	controlHandlers[toggle(3)] = [this](int val) { post[0]->setEnabled(val); };
+
+	detector.setup(DetectorConfig::load("detector.json"));
+	detector.start();
 
 	randDetectionSpeed = ofRandom(0.1f, 32.0f);
 }
 
 //-----------------------------------------------------------------------------------------------------------
 void ofApp::update() {
-	updateCamera();
+	frameStartMicros = Profiler::now();
 
-	AllocateImages();
+	updateCamera();
 
+	// hand the frame to the vision thread and take whatever it finished last, without waiting
 	if (bNewFrame) {
 		processNewFrame();
-		calculateOpticalFlow();
+	}
+	vision.update();
+
+	AllocateImages();
+
+	// spacing changes from the UI, keys and websocket land here, at most one regeneration per frame
+	if (bParticlesDirty) {
+		generateParticles(sourceWidth, sourceHeight);
+		bParticlesDirty       = false;
+		bParticlesRegenerated = true;
 	}
 
+	// flow seeds new tracks; it spans two processed camera frames, not two render frames
+	const VisionWorker::Output &visionOut = vision.read();
+	float                       flowRate  = visionOut.flowMicros > 0 ? 1000000.0f / visionOut.flowMicros : 0.0f;
+	tracker.setFlow(&visionOut.flow, sourceWidth, sourceHeight, visionOut.bMirror, flowRate);
+
+	// the tracker is fed with capture timestamps, so inference latency is extrapolated away too
+	double now = ofGetElapsedTimeMicros() / 1000000.0;
+	if (detector.update()) {
+		tracker.update(detector.getResults(), detector.getResultTime());
+	}
+	tracker.predict(now);
+
 	updateParticles();
 	applyFlowToPlayers();
 
@@ -164,22 +213,47 @@ void ofApp::update() {
 
 	collision();
 
-	// update params from websocket
-	if (webSocket.isConnected) {
-		ofWebSocket::ParsedData data = webSocket.parsedData;
+	applyControlCommands();
+}
+
+// everything the websocket queued since the last frame, each control once with its latest value
+void ofApp::applyControlCommands() {
+	uint32_t changed = 0; // bit per control id
 
-		auto it = sliderHandlers.find(data.id);
-		if (it != sliderHandlers.end()) {
-			it->second(data.param);
+	ofWebSocket::ControlCommand command;
+	while (webSocket.poll(command)) {
+		uint32_t bit = 1u << command.control;
+		if (changed & bit) {
+			coalescedControls++;
 		}
+		changed |= bit;
+		pendingControls[command.control] = command.value;
 
-		auto t_it = togglesHandlers.find(data.id);
-		if (t_it != togglesHandlers.end()) {
-			t_it->second(data.param);
+		// the oldest input of the frame, closed by the end of draw() in controlsPresented()
+		if (controlReceivedMicros == 0) {
+			controlReceivedMicros = command.receivedMicros;
+		}
+	}
+
+	for (int control = 0; changed != 0; control++, changed >>= 1) {
+		if ((changed & 1) && controlHandlers[control]) {
+			controlHandlers[control](pendingControls[control]);
 		}
 	}
 }
 
+// end of draw(): arrival of the oldest control applied this frame -> its first drawn frame. Swap
+// and scanout come on top, the network on the way in is the panel's round trip it shows itself.
+void ofApp::controlsPresented() {
+	if (controlReceivedMicros == 0) {
+		return;
+	}
+	float ms              = (ofGetElapsedTimeMicros() - controlReceivedMicros) / 1000.0f;
+	controlLatencyMs      = controlLatencyMs == 0.0f ? ms : ofLerp(controlLatencyMs, ms, 0.1f);
+	controlReceivedMicros = 0;
+	webSocket.setDisplayLatency(controlLatencyMs);
+}
+
 //-----------------------------------------------------------------------------------------------------------
 
 void ofApp::draw() {
@@ -189,7 +263,7 @@ void ofApp::draw() {
 	ofBackgroundGradient(ofColor(0), bgColor);
 	ofSetColor(255);
 
-	if (grayImage.bAllocated) {
+	if (vision.isReady()) {
 		ofSetColor(255, 255, 255, 255);
 		drawParticles();
 		ofSetColor(255, 255, 255, 255);
@@ -200,26 +274,14 @@ void ofApp::draw() {
 
 	ofSetColor(255);
 
-	if (b_Ascii && asciiShader.isLoaded()) {
-		asciiShader.begin();
-		asciiShader.setUniformTexture("tex0", colorImg.getTexture(), 0);
-		asciiShader.setUniformTexture("asciiAtlas", asciiAtlas, 1);
-		asciiShader.setUniform1f("cellSize", atlasCellSize);
-		asciiShader.setUniform2f("atlasSize", atlasSize_grid.x, atlasSize_grid.y);
-		asciiShader.setUniform1f("scaleFont", s_asciiFontScale);
-		asciiShader.setUniform1f("charsetOffset", s_asciiCharsetOffset);
-		asciiShader.setUniform1f("time", ofGetElapsedTimef());
-		asciiShader.setUniform1f("shader_mix", s_asciiMix);
-	}
-
-	particlesFbo.draw(0, 0);
-
-	if (b_Ascii && asciiShader.isLoaded())
-		asciiShader.end();
+	drawAsciiPass();
 
 	drawDetectedObjects();
 
-	post.end();
+	{
+		Profiler::Scope postScope(Profiler::STAGE_POST);
+		post.end();
+	}
 
 	//-----------------------------------------------------------------------------------------------------------
 	player1.draw();
@@ -254,31 +316,105 @@ void ofApp::draw() {
 
 #ifdef UI
 	uiManager.draw();
+	drawDetectionStats();
+	drawVisionStats();
+	drawControlStats();
+
+	Profiler::global().setEnabled(uiManager.profiler_t);
+	Profiler::global().drawOverlay(WIN_W - 720, WIN_H - 200, 480, 160);
+
+	particleBudget.settings.enabled  = uiManager.lod_t;
+	particleBudget.settings.budgetMs = uiManager.budget_s;
+	uiManager.lod_l = "spacing " + ofToString(particleSpacing) + ", " + ofToString(particleBudget.getAverageMs(), 1) +
+	                  " ms, " + ParticleBudget::stateName(particleBudget.getState());
+
+	// levels and window drive Farneback, the sparse tracker has its own
+	FlowEngine::Settings &flow = vision.flowSettings;
+	flow.backend               = (FlowEngine::Backend)(int)uiManager.flowBackend_s;
+	flow.disPreset             = (FlowEngine::DisPreset)(int)uiManager.disPreset_s;
+	flow.levels                = uiManager.flowLevels_s;
+	flow.winSize               = uiManager.flowWinSize_s;
+	flow.gridStep              = uiManager.flowGridStep_s;
+	flow.bandWidth             = uiManager.flowBand_s;
+	flow.lkLevels              = uiManager.lkLevels_s;
+	flow.lkWinSize             = uiManager.lkWinSize_s;
+
+	FlowEngine::Backend active = vision.read().backend;
+	std::string         name   = FlowEngine::backendName(active);
+	if (active == FlowEngine::BACKEND_DIS) {
+		name += std::string(" ") + FlowEngine::presetName(flow.disPreset);
+	}
+	uiManager.flow_l = name + ", " + ofToString(vision.read().flowAverageMs, 2) + " ms";
 #endif
+
+	// particle level of detail from this frame's CPU work, vsync wait excluded. A frame that
+	// regenerated the grid pays for the resize and the slot inheritance once; fed to the budget
+	// it would start the new grid's average over budget and could undo the step that caused it
+	float workMs = (Profiler::now() - frameStartMicros) / 1000.0f;
+	if (bParticlesRegenerated) {
+		bParticlesRegenerated = false;
+	} else if (gridSpacing(particleBudget.update(workMs, spacing)) != particleSpacing) {
+		bParticlesDirty = true;
+	}
+
+	vision.presented();
+	controlsPresented();
+	Profiler::global().endFrame();
 }
 //---------------------------------------------------------------------------------
 
 
+// draws the particles fbo to the screen, through the ascii shader when enabled
+void ofApp::drawAsciiPass() {
+	Profiler::Scope scope(Profiler::STAGE_ASCII);
+
+	if (b_Ascii && asciiShader.isLoaded() && vision.isReady()) {
+		// the vision thread has no GL context, upload its camera pixels here once per result
+		const VisionWorker::Output &frame = vision.read();
+		if (!cameraTexture.isAllocated() || cameraTexture.getWidth() != frame.pixels.getWidth()
+		    || cameraTexture.getHeight() != frame.pixels.getHeight()) {
+			cameraTexture.allocate(frame.pixels);
+		}
+		if (cameraTextureCapture != frame.captureMicros) {
+			cameraTexture.loadData(frame.pixels);
+			cameraTextureCapture = frame.captureMicros;
+		}
+
+		asciiShader.begin();
+		asciiShader.setUniformTexture("tex0", cameraTexture, 0);
+		asciiShader.setUniformTexture("asciiAtlas", asciiAtlas, 1);
+		asciiShader.setUniform1f("cellSize", atlasCellSize);
+		asciiShader.setUniform2f("atlasSize", atlasSize_grid.x, atlasSize_grid.y);
+		asciiShader.setUniform1f("scaleFont", s_asciiFontScale);
+		asciiShader.setUniform1f("charsetOffset", s_asciiCharsetOffset);
+		asciiShader.setUniform1f("time", ofGetElapsedTimef());
+		asciiShader.setUniform1f("shader_mix", s_asciiMix);
+	}
+
+	particlesFbo.draw(0, 0);
+
+	if (b_Ascii && asciiShader.isLoaded() && vision.isReady())
+		asciiShader.end();
+}
+
 void ofApp::drawDetectedObjects() {
-	if (!colorImg.bAllocated) {
+	const ofPixels &camera = vision.read().pixels;
+	if (!camera.isAllocated()) {
 		return;
 	}
 
 	ofNoFill();
 	ofSetColor(255, 0, 255, 255);
 
-	float scaleX = (float)WIN_W / colorImg.getWidth();
-	float scaleY = (float)WIN_H / colorImg.getHeight();
-
+	float scaleX = (float)WIN_W / camera.getWidth();
+	float scaleY = (float)WIN_H / camera.getHeight();
 
-	for (auto res : results) {
-		auto rect = res.rect;
 
-		if (res.label.empty())
-			continue;
+	for (const auto &track : tracker.getTracks()) {
+		auto rect = track.predicted;
 
-		if (bMirror) {
-			rect.x = colorImg.getWidth() - rect.x - rect.width;
+		if (vision.read().bMirror) {
+			rect.x = camera.getWidth() - rect.x - rect.width;
 		}
 
 		ofRectangle scaledRect(rect.x * scaleX, rect.y * scaleY, rect.width * scaleX, rect.height * scaleY);
@@ -297,101 +433,151 @@ void ofApp::drawDetectedObjects() {
 		glm::vec3 labely = scaledRect.getTopLeft() + glm::vec3(0, yOffset, 0);
 
 		ofSetColor(0, 255, 25, 255);
-		font.drawString(res.label, labely.x, labely.y);
+		font.drawString(track.label, labely.x, labely.y);
 	}
 	ofFill();
 }
 
+void ofApp::drawDetectionStats() {
+	DetectionWorker::Stats stats = detector.getStats();
+
+	std::string info = "yolo " + ofToString(stats.inputSize) + "px every " + ofToString(stats.detectInterval) +
+	                   " frames, " + ofToString(stats.inferenceMs, 1) + " ms (avg " + ofToString(stats.avgInferenceMs, 1) +
+	                   ")  dropped " + ofToString(stats.dropped) + "/" + ofToString(stats.submitted) + "  age " +
+	                   ofToString(stats.resultAgeMs, 0) + " ms / " + ofToString(stats.resultAgeFrames) + " frames";
+
+	ofDrawBitmapStringHighlight(info, 10, WIN_H - 10);
+}
+
+void ofApp::drawVisionStats() {
+	VisionWorker::Stats    stats     = vision.getStats();
+	DetectionWorker::Stats detection = detector.getStats();
+
+	// image copies per camera frame: the vision worker's, plus the detector's submit() spread over its interval
+	size_t detectionBytes = detection.copiedBytes / std::max(1, detection.detectInterval);
+
+	std::string info = "vision " + ofToString(stats.processMs, 1) + " + flow " + ofToString(stats.flowMs, 1) +
+	                   " ms  queue in " + ofToString(stats.inputDepth) + " busy " + ofToString(stats.inFlight) +
+	                   " out " + ofToString(stats.outputDepth) + "  dropped " + ofToString(stats.dropped) + "/" +
+	                   ofToString(stats.submitted) + " skipped " + ofToString(stats.skipped) + "  capture->result " +
+	                   ofToString(stats.pipelineMs, 1) + " ms, capture->draw " + ofToString(stats.toPhotonMs, 1) +
+	                   " ms  copied " + ofToString(stats.copiedBytes / 1024) + " + " +
+	                   ofToString(detectionBytes / 1024) + " KB/frame";
+
+	ofDrawBitmapStringHighlight(info, 10, WIN_H - 30);
+}
+
+void ofApp::drawControlStats() {
+	std::string link;
+	if (webSocket.isServing()) {
+		link = "serving " + ofToString(webSocket.getClientCount()) + " panels, rate limited " +
+		       ofToString(webSocket.getRateLimitedCount());
+	} else {
+		link = std::string(webSocket.isConnected ? "connected" : "offline") + " ping " +
+		       ofToString(webSocket.getPingMs(), 1) + " ms reconnects " + ofToString(webSocket.getReconnectCount());
+	}
+
+	std::string info = "websocket " + link + "  input->draw " + ofToString(controlLatencyMs, 1) + " ms  received " +
+	                   ofToString(webSocket.getReceivedCount()) + " (binary " +
+	                   ofToString(webSocket.getBinaryCount()) + ") queued " + ofToString(webSocket.getQueueDepth()) +
+	                   " dropped " + ofToString(webSocket.getDroppedCount()) + " invalid " +
+	                   ofToString(webSocket.getInvalidCount()) + " coalesced " + ofToString(coalescedControls);
+
+	ofDrawBitmapStringHighlight(info, 10, WIN_H - 50);
+}
+
 //-----------------------------------------------------------------------------------------------------------
 
 
+// spacing the grid is generated with for a requested spacing, out of range falls back to 20
+int ofApp::gridSpacing(int requested) const {
+	if (requested <= 0 || requested > 100) {
+		return 20;
+	}
+	return requested;
+}
+
 void ofApp::generateParticles(int s_width, int s_height) {
-	float effectiveSpacing = spacing;
+	int effectiveSpacing = gridSpacing(particleBudget.getSpacing(spacing));
 
-	if (effectiveSpacing <= 0 || effectiveSpacing > 100) {
-		effectiveSpacing = 20;
-	}
 	particleSystem.generateParticles(s_width, s_height, effectiveSpacing);
+	gpuParticles.generateParticles(s_width, s_height, effectiveSpacing);
+	particleSpacing = effectiveSpacing;
 }
 
 void ofApp::updateParticles() {
+	Profiler::Scope scope(Profiler::STAGE_PARTICLES);
+
 	float deltaTime = ofClamp(ofGetLastFrameTime(), 1.f / 120.f, 1.f / 10.f); // reasonable clamp
-	particleSystem.updateParticles(flowMat, deltaTime, minLengthSquared, sourceWidth, sourceHeight, bMirror);
+
+	// newest vision result; flow and colors come from the same camera frame
+	const VisionWorker::Output &frame = vision.read();
+
+	if (useGpuParticles()) {
+		// integration and color sampling in shaders, only the paddle flow comes back
+		gpuParticles.update(frame.flow, frame.pixels, deltaTime, minLengthSquared, sourceWidth, sourceHeight,
+		                    particle_size, frame.bMirror);
+		leftFlowVector  = gpuParticles.getLeftFlowVector();
+		rightFlowVector = gpuParticles.getRightFlowVector();
+		return;
+	}
+
+	particleSystem.updateParticles(frame.flow, deltaTime, minLengthSquared, sourceWidth, sourceHeight, frame.bMirror,
+	                               frame.pixels, particle_size);
 
 	leftFlowVector  = particleSystem.getLeftFlowVector();
 	rightFlowVector = particleSystem.getRightFlowVector();
 }
 
 void ofApp::drawParticles() {
-	const ofPixels &vpix = colorImg.getPixels();
+	const ofPixels &vpix = vision.read().pixels;
 
 	int   imgW  = vpix.getWidth();
 	int   imgH  = vpix.getHeight();
 	float xmult = WIN_W / (float)imgW;
 	float ymult = WIN_H / (float)imgH;
 
-	particleSystem.updateColors(vpix, particle_size, bMirror);
-	particleSystem.draw(xmult, ymult, particle_size);
+	Profiler::Scope scope(Profiler::STAGE_MESH);
+	if (useGpuParticles()) {
+		gpuParticles.draw(xmult, ymult);
+		return;
+	}
+
+	// colors and sizes were sampled by the fused update in updateParticles()
+	particleSystem.buildMesh(xmult, ymult);
+	particleSystem.draw(particle_size);
 }
 
 //-------------------------------------------------------------------------------------
 
 void ofApp::updateCamera() {
-	cam.update();
-	bNewFrame     = cam.isFrameNew();
-	colorImageRGB = cam.getPixels();
-	depthOrig     = colorImageRGB;
+	Profiler::Scope scope(Profiler::STAGE_CAMERA);
+
+	// nothing is copied here; new frames go to the vision and detection threads, old ones nowhere
+	source->update();
+	bNewFrame = source->isFrameNew();
 }
 
+// the vision thread reallocates its buffers when cvDownScale changes; the grid follows the
+// first result of a new size, as it did when the buffers were allocated here
 void ofApp::AllocateImages() {
-	int scaledWidth  = sourceWidth / cvDownScale;
-	int scaledHeight = sourceHeight / cvDownScale;
-
-	if (currentImage.getWidth() != scaledWidth || currentImage.getHeight() != scaledHeight) {
-		previousMat = cv::Mat(scaledHeight, scaledWidth, CV_8UC1);
-		flowMat     = cv::Mat(scaledHeight, scaledWidth, CV_32FC2);
-		// currentImage.clear();
-		currentImage.allocate(scaledWidth, scaledHeight);
-		currentImage.set(0);
-		previousMat.release();
-		currentImage.getCvMat().copyTo(previousMat);
-		flowMat.release();
-		flowMat = cv::Mat(scaledHeight, scaledWidth, CV_32FC2);
-
-		generateParticles(sourceWidth, sourceHeight);
+	if (vision.isReady() && vision.read().flow.size() != flowSize) {
+		flowSize        = vision.read().flow.size();
+		bParticlesDirty = true;
 	}
 }
 
 
 void ofApp::processNewFrame() {
-	auto pixels = cam.getPixels();
-	colorImg.setFromPixels(pixels);
-	grayImage = colorImg;
-
-	if (bMirror)
-		grayImage.mirror(false, true);
+	const ofPixels &pixels = source->getPixels();
 
-	currentImage.scaleIntoMe(grayImage);
+	// gray, downscale and flow run on the vision thread, timed there as STAGE_GRAY / STAGE_FLOW
+	vision.submit(pixels, ofGetFrameNum());
 
-	auto cvMat = cv::cvarrToMat(colorImg.getCvImage());
-
-	if (ofGetFrameNum() % 3 == 0) {
-		results = classify.classifyFrame(cvMat);
+	// the worker only ever takes the newest frame, stale ones are dropped on its side
+	if (ofGetFrameNum() % detector.getDetectInterval() == 0) {
+		detector.submit(pixels, ofGetFrameNum());
 	}
-
-	if (bContrastStretch)
-		currentImage.contrastStretch();
-
-	if (blurAmount > 0)
-		currentImage.blurGaussian(blurAmount);
-}
-
-void ofApp::calculateOpticalFlow() {
-	cv::Mat currentMat = currentImage.getCvMat();
-	cv::calcOpticalFlowFarneback(previousMat, currentMat, flowMat, 0.5, 4, 4, 2, 4, 1.2,
-	                             cv::OPTFLOW_FARNEBACK_GAUSSIAN);
-
-	currentMat.copyTo(previousMat);
 }
 
 
@@ -439,7 +625,8 @@ void ofApp::applyFlowToPlayers() {
 glm::vec2 ofApp::getOpticalFlowValueForPercent(float xpct, float ypct) {
 	glm::vec2 flowVector(0, 0);
 
-	if (flowMat.empty() || !grayImage.bAllocated) {
+	const cv::Mat &flowMat = vision.read().flow;
+	if (flowMat.empty() || !vision.isReady()) {
 		return flowVector;
 	}
 
@@ -518,12 +705,12 @@ void ofApp::keyPressed(int key) {
 			break;
 
 		case OF_KEY_UP:
-			cvDownScale += 1.f;
+			vision.settings.cvDownScale += 1.f;
 			break;
 		case OF_KEY_DOWN:
-			cvDownScale -= 1.0f;
-			if (cvDownScale < 2) {
-				cvDownScale = 2;
+			vision.settings.cvDownScale -= 1.0f;
+			if (vision.settings.cvDownScale < 2) {
+				vision.settings.cvDownScale = 2;
 			}
 			break;
 		case 's':
@@ -561,6 +748,42 @@ void ofApp::keyPressed(int key) {
 			counter++;
 			loadTextureFromFile(counter);
 			break;
+
+		case 'b':
+			detector.requestBenchmark();
+			break;
+
+		case 't':
+			dumpTrace();
+			break;
+
+		case 'g': {
+			bool enabled = !bGpuParticles;
+			gpuParticlesChanged(enabled);
+#ifdef UI
+			uiManager.gpuParticles_t = bGpuParticles;
+#endif
+			break;
+		}
+
+		case 'f': {
+			// cycle the optical flow backend
+			int backend                 = (vision.flowSettings.backend + 1) % FlowEngine::BACKEND_COUNT;
+			vision.flowSettings.backend = (FlowEngine::Backend)backend;
+#ifdef UI
+			uiManager.flowBackend_s = backend;
+#endif
+			ofLogNotice("ofApp") << "Optical flow: " << FlowEngine::backendName(backend);
+			break;
+		}
+
+		case 'i': {
+			// cycle the detector input size
+			const auto &sizes = detector.getInputSizes();
+			auto        it    = std::find(sizes.begin(), sizes.end(), detector.getStats().inputSize);
+			detector.requestInputSize(it == sizes.end() || it + 1 == sizes.end() ? sizes.front() : *(it + 1));
+			break;
+		}
 	}
 }
 
@@ -578,11 +801,36 @@ void ofApp::windowResized(int w, int h) {
 	ofSetWindowShape(WIN_W, WIN_H);
 }
 
+void ofApp::gpuParticlesChanged(bool &enabled) {
+	if (enabled && !gpuParticles.isSupported()) {
+		enabled = false;
+	}
+	bGpuParticles = enabled;
+	ofLogNotice("ofApp") << "Particles simulated on the " << (bGpuParticles ? "GPU" : "CPU");
+}
+
+// update and draw ask the same question; a GPU system that turned out unsupported switches the
+// app (and the toggle) back to the CPU path instead of leaving an empty particle layer
+bool ofApp::useGpuParticles() {
+	if (bGpuParticles && !gpuParticles.isSupported()) {
+		bGpuParticles = false;
+#ifdef UI
+		uiManager.gpuParticles_t = false;
+#endif
+		ofLogWarning("ofApp") << "GPU particles unavailable, simulating on the CPU";
+	}
+	return bGpuParticles;
+}
+
 void ofApp::spacingChanged(int &spacing) {
-	this->spacing = spacing;
 	spacing       = ofClamp(spacing, 2, 32);
+	this->spacing = spacing;
+
+	bParticlesDirty = true;
+}
 
-	generateParticles(WIN_W, WIN_H);
+void ofApp::dumpTrace() {
+	Profiler::global().dumpTrace("trace_" + ofGetTimestampString() + ".json");
 }
 
 void ofApp::particleSizeChanged(float &particle_size) {
@@ -10,9 +10,15 @@
 #include "ofxOpenCv.h"
 #include "ofxPostProcessing.h"
 
+#include "DetectionTracker.h"
+#include "DetectionWorker.h"
+#include "FrameSource.h"
 #include "GameManager.h"
+#include "GpuParticleSystem.h"
+#include "ParticleBudget.h"
 #include "Particles.h"
-#include "yolo5ImageClassify.h"
+#include "Profiler.h"
+#include "VisionWorker.h"
 
 #define UI
 
@@ -28,28 +34,30 @@ public:
 
 	void windowResized(int w, int h);
 
-	ofVideoGrabber cam;
+	// set by main() from the command line before setup()
+	std::string         sourceSpec      = "camera";
+	bool                bFreeRun        = false;
+	int                 particleThreads = 0; // 0 = all cores
+	bool                bGpuParticles   = false;
+	FlowEngine::Backend flowBackend     = FlowEngine::BACKEND_FARNEBACK;
+	std::string         controlUri      = "ws://ws.42ls.online/of-ws"; // empty: no remote control
+	int                 controlPort     = 0; // > 0: serve the panel and its websockets here instead
 
-	ofxCvColorImage     colorImg;
-	ofxCvGrayscaleImage grayImage;
-	ofxCvGrayscaleImage currentImage;
+	std::unique_ptr<FrameSource> source;
 
-	cv::Mat previousMat;
-	cv::Mat flowMat;
+	VisionWorker vision; // gray, downscale and flow off the render thread
 
-	ParticleSystem particleSystem;
+	ParticleSystem    particleSystem;
+	GpuParticleSystem gpuParticles;
+	ParticleBudget    particleBudget;
 
 	ofShader particleShader;
 
-	bool bMirror;
-	bool bContrastStretch;
 	bool bDrawOptiFlowVectors;
 
-	float cvDownScale;
 	float minLengthSquared;
 
 	int mode;
-	int blurAmount;
 	int spacing;
 
 	Player player1;
@@ -64,17 +72,20 @@ public:
 	ofShader  asciiShader;
 	ofFbo     particlesFbo;
 	ofTexture asciiAtlas;
+	ofTexture cameraTexture; // camera color for the ascii pass
+	uint64_t  cameraTextureCapture = 0;
 
-	ofWebSocket                                                  webSocket;
-	std::unordered_map<std::string, std::function<void(float)> > sliderHandlers;
-	std::unordered_map<std::string, std::function<void(int)> >   togglesHandlers;
+	ofWebSocket                                                           webSocket;
+	std::array<std::function<void(int)>, ControlProtocol::CONTROL_COUNT> controlHandlers;
+	std::array<uint16_t, ControlProtocol::CONTROL_COUNT>                 pendingControls;       // latest value per id
+	uint64_t                                                             coalescedControls = 0; // commands superseded
 
 	std::vector<std::string> fontmaps;
 	unsigned int             maps_count;
 	unsigned int             counter;
 
-	yolo5ImageClassify                 classify;
-	vector<yolo5ImageClassify::Result> results;
+	DetectionWorker  detector;
+	DetectionTracker tracker;
 
 	int sourceWidth;
 	int sourceHeight;
@@ -83,7 +94,16 @@ public:
 	unsigned short int WIN_W;
 
 private:
-	bool bNewFrame;
+	bool     bNewFrame;
+	bool     bParticlesDirty       = false; // regenerate the particle grid on the next update()
+	bool     bParticlesRegenerated = false; // this frame regenerated the grid, not a budget sample
+	cv::Size flowSize;                      // of the last vision result, a change regenerates the grid
+
+	int      particleSpacing  = 0; // spacing of the current grid, spacing or coarser when over budget
+	uint64_t frameStartMicros = 0;
+
+	uint64_t controlReceivedMicros = 0;    // oldest control applied since the last draw, 0 = none
+	float    controlLatencyMs      = 0.0f; // control arrival -> end of its first draw, smoothed
 
 	bool b_Ascii;
 
@@ -92,11 +112,6 @@ private:
 
 	float flowSensitivity;
 
-	ofxCvGrayscaleImage depthOrig;
-	ofxCvGrayscaleImage depthProcessed;
-	ofxCvContourFinder  depthContours;
-	ofxCvColorImage     colorImageRGB;
-
 	float   s_asciiFontScale;
 	ofVec2f atlasSize_grid;
 	float   atlasCellSize;
@@ -110,6 +125,7 @@ private:
 
 	void calculateNeighbors();
 	void generateParticles(int w, int h);
+	int  gridSpacing(int requested) const;
 
 	void spacingChanged(int &spacing);
 	void particleSizeChanged(float &particle_size);
@@ -117,6 +133,9 @@ private:
 	void asciiSpreadChanged(int &spread);
 	void asciiOffsetChanged(int &offset);
 	void asciiMixChanged(float &mix);
+	void dumpTrace();
+	void gpuParticlesChanged(bool &enabled);
+	bool useGpuParticles();
 
 	void collision();
 
@@ -124,11 +143,16 @@ private:
 	void updateCamera();
 	void AllocateImages();
 	void processNewFrame();
-	void calculateOpticalFlow();
 	void updateParticles();
 	void applyFlowToPlayers();
 
+	void drawAsciiPass();
 	void drawDetectedObjects();
+	void drawDetectionStats();
+	void drawVisionStats();
+	void drawControlStats();
+	void applyControlCommands();
+	void controlsPresented();
 
 	void loadTextureFromFile(int index);
 	void loadMapNames();
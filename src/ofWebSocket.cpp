@@ -12,6 +12,16 @@ ofWebSocket::ofWebSocket() : isConnected(false) {
 	wsClient.set_open_handler(bind(&ofWebSocket::onOpen, this, _1));
 	wsClient.set_fail_handler(bind(&ofWebSocket::onFail, this, _1));
 	wsClient.set_close_handler(bind(&ofWebSocket::onClose, this, _1));
+	wsClient.set_pong_handler(bind(&ofWebSocket::onPong, this, _1, _2));
+
+	wsServer.clear_access_channels(websocketpp::log::alevel::all);
+	wsServer.init_asio();
+	wsServer.set_reuse_addr(true);
+
+	wsServer.set_http_handler(bind(&ofWebSocket::onHttp, this, _1));
+	wsServer.set_open_handler(bind(&ofWebSocket::onServerOpen, this, _1));
+	wsServer.set_close_handler(bind(&ofWebSocket::onServerClose, this, _1));
+	wsServer.set_message_handler(bind(&ofWebSocket::onServerMessage, this, _1, _2));
 }
 
 ofWebSocket::~ofWebSocket() {
@@ -19,77 +29,353 @@ ofWebSocket::~ofWebSocket() {
 }
 
 void ofWebSocket::connect(const std::string &uri) {
+	close();
+
+	this->uri = uri;
+	running   = true;
+
+	// run() returns once close() took the perpetual work away, reset() makes it runnable again
+	wsClient.reset();
+	wsClient.start_perpetual();
+	clientThread = std::thread(&ofWebSocket::run, this);
+
+	wsClient.set_timer(0, [this](const websocketpp::lib::error_code &) {
+		backoffMs = 0;
+		attempted = false;
+		startConnect();
+	});
+}
+
+void ofWebSocket::run() {
+	try {
+		wsClient.run();
+	} catch (const std::exception &e) {
+		ofLogError("ofWebSocket") << "Run exception: " << e.what();
+	}
+}
+
+// asio thread
+void ofWebSocket::startConnect() {
+	if (!running) {
+		return;
+	}
+	if (attempted) {
+		reconnects++;
+	}
+	attempted = true;
+
 	websocketpp::lib::error_code ec;
-	auto                         con = wsClient.get_connection(uri, ec);
+	client::connection_ptr       con = wsClient.get_connection(uri, ec);
 	if (ec) {
 		ofLogError("ofWebSocket") << "Connection error: " << ec.message();
+		scheduleReconnect();
 		return;
 	}
 
 	connection = con->get_handle();
 	wsClient.connect(con);
+}
 
-	clientThread = std::thread(&ofWebSocket::run, this);
+// asio thread, 250 ms, 500 ms, 1 s ... up to reconnectMaxMs; a successful open starts over
+void ofWebSocket::scheduleReconnect() {
+	if (!running) {
+		return;
+	}
+	backoffMs = backoffMs == 0 ? settings.reconnectMinMs : std::min(backoffMs * 2, settings.reconnectMaxMs);
+	ofLogNotice("ofWebSocket") << "Reconnecting to " << uri << " in " << backoffMs << " ms";
+
+	reconnectTimer = wsClient.set_timer(backoffMs, [this](const websocketpp::lib::error_code &ec) {
+		if (!ec) {
+			startConnect();
+		}
+	});
 }
 
-void ofWebSocket::run() {
-	try {
-		wsClient.run();
-	} catch (const std::exception &e) {
-		ofLogError("ofWebSocket") << "Run exception: " << e.what();
+// asio thread, the payload carries the send time so the pong measures the round trip. The pong
+// timeout is tracked here rather than by websocketpp, whose ping() re-arms the timeout of the
+// previous ping: with a ping every second a 3 s timeout would never fire. While a ping is
+// unanswered no new one is sent, and pongTimer ends the connection if it stays unanswered.
+void ofWebSocket::schedulePing() {
+	pingTimer = wsClient.set_timer(settings.pingIntervalMs, [this](const websocketpp::lib::error_code &ec) {
+		if (ec || !running || !isConnected) {
+			return;
+		}
+		if (!pingOutstanding) {
+			websocketpp::lib::error_code pingError;
+			wsClient.ping(connection, ofToString(ofGetElapsedTimeMicros()), pingError);
+			if (pingError) {
+				ofLogWarning("ofWebSocket") << "Ping failed: " << pingError.message();
+			} else {
+				schedulePongTimeout();
+			}
+		}
+		// the panels behind the relay show it next to their own round trip
+		sendNow("{\"latency\":" + ofToString(displayLatencyMs.load(), 1) + "}");
+		schedulePing();
+	});
+}
+
+// asio thread, right after a ping went out
+void ofWebSocket::schedulePongTimeout() {
+	pingOutstanding = true;
+	pongTimer       = wsClient.set_timer(settings.pongTimeoutMs, [this](const websocketpp::lib::error_code &ec) {
+		if (!ec && pingOutstanding) {
+			onPongTimeout();
+		}
+	});
+}
+
+// asio thread: cancels the timers and closes the connection, run() returns once the close is done
+void ofWebSocket::shutdown() {
+	if (reconnectTimer) {
+		reconnectTimer->cancel();
+	}
+	if (pingTimer) {
+		pingTimer->cancel();
+	}
+	if (pongTimer) {
+		pongTimer->cancel();
+	}
+
+	websocketpp::lib::error_code ec;
+	client::connection_ptr       con = wsClient.get_con_from_hdl(connection, ec);
+	if (!ec) {
+		if (con->get_state() == websocketpp::session::state::open) {
+			con->close(websocketpp::close::status::normal, "Closing", ec);
+			if (ec) {
+				ofLogError("ofWebSocket") << "Close failed: " << ec.message();
+			}
+		} else if (con->get_state() == websocketpp::session::state::connecting) {
+			con->terminate(websocketpp::lib::error_code());
+		}
 	}
+	wsClient.stop_perpetual();
 }
 
-void ofWebSocket::parsePayload(const std::string &payload) {
+void ofWebSocket::parsePayload(websocketpp::connection_hdl from, const std::string &payload) {
 	if (payload.empty()) {
 		ofLogError("ofWebSocket") << "Empty payload received.";
+		invalid++;
 		return;
 	}
 	if (payload[0] != '{') {
 		ofLogError("ofWebSocket") << "Invalid payload format: " << payload;
+		invalid++;
 		return;
 	}
 
-	ofJson json;
+	int control = -1;
+	int value   = 0;
 
 	try {
-		json = ofJson::parse(payload);
+		ofJson json = ofJson::parse(payload);
+
+		// handshake, not a control: a panel that just connected asks what the app understands
+		if (json.contains("hello")) {
+			reply(from, ControlProtocol::capsMessage());
+			return;
+		}
+		// a panel timing its round trip to the app, answered with the same fields
+		if (json.contains("ping")) {
+			json["pong"] = json["ping"];
+			json.erase("ping");
+			reply(from, json.dump());
+			return;
+		}
+		if (json.contains("caps") || json.contains("pong") || json.contains("latency")) {
+			return;
+		}
+
+		control = ControlProtocol::parseName(json["id"].get<std::string>());
+		value   = json["param"];
 	} catch (std::exception &e) {
 		ofLogError("ofWebSocket") << "JSON parse error: " << e.what();
+		invalid++;
 		return;
 	}
 
-	parsedData.id               = json["id"];
-	parsedData.param            = json["param"];
-	parsedData.total_parameters = json["total_parameters"];
+	if (control < 0) {
+		ofLogWarning("ofWebSocket") << "Unknown control in " << payload;
+		invalid++;
+		return;
+	}
+	queue(from, control, value);
+}
+
+// batched 3 byte records, see ControlProtocol.h
+void ofWebSocket::decodeBinary(websocketpp::connection_hdl from, const std::string &payload) {
+	bool valid = ControlProtocol::decode((const uint8_t *)payload.data(), payload.size(),
+	                                     [&](int control, int value) { queue(from, control, value); });
+	if (!valid) {
+		ofLogWarning("ofWebSocket") << "Malformed binary control frame, " << payload.size() << " bytes";
+		invalid++;
+		return;
+	}
+	binary += payload.size() / ControlProtocol::RECORD_SIZE;
+}
+
+void ofWebSocket::queue(websocketpp::connection_hdl from, int control, int value) {
+	ControlCommand command;
+	command.control        = control;
+	command.value          = ofClamp(value, 0, 0xffff);
+	command.receivedMicros = ofGetElapsedTimeMicros();
+
+	received++;
+	if (!commands.push(command)) {
+		dropped++;
+		return;
+	}
+
+	if (serving) {
+		// the other panels see it with the next broadcast
+		controlState[control] = command.value;
+		lastSender[control]   = from;
+		changedControls |= 1u << control;
+	}
+}
+
+// asio thread, to the panel (server mode) or through the relay (client mode)
+void ofWebSocket::reply(websocketpp::connection_hdl to, const std::string &message) {
+	if (!serving) {
+		sendNow(message);
+		return;
+	}
+	websocketpp::lib::error_code ec;
+	wsServer.send(to, message, websocketpp::frame::opcode::text, ec);
+}
+
+bool ofWebSocket::poll(ControlCommand &command) {
+	return commands.pop(command);
+}
+
+size_t ofWebSocket::getQueueDepth() const {
+	return commands.size();
 }
 
+uint64_t ofWebSocket::getReceivedCount() const {
+	return received;
+}
+
+uint64_t ofWebSocket::getDroppedCount() const {
+	return dropped;
+}
+
+uint64_t ofWebSocket::getInvalidCount() const {
+	return invalid;
+}
+
+uint64_t ofWebSocket::getBinaryCount() const {
+	return binary;
+}
+
+uint64_t ofWebSocket::getReconnectCount() const {
+	return reconnects;
+}
+
+float ofWebSocket::getPingMs() const {
+	return pingMs;
+}
+
+const std::string &ofWebSocket::getUri() const {
+	return uri;
+}
+
+// asio thread
 void ofWebSocket::onMessageInternal(websocketpp::connection_hdl hdl, message_ptr msg) {
-	std::string payload = msg->get_payload();
-	ofLogVerbose("ofWebSocket") << "Message received: " << payload;
+	const std::string &payload = msg->get_payload();
+
+	if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+		decodeBinary(hdl, payload);
+		return;
+	}
 
+	ofLogVerbose("ofWebSocket") << "Message received: " << payload;
 	if (onMessage) {
 		onMessage(payload);
-		parsePayload(payload);
 	}
+	parsePayload(hdl, payload);
 }
 
 void ofWebSocket::onOpen(websocketpp::connection_hdl hdl) {
-	isConnected = true;
+	isConnected     = true;
+	backoffMs       = 0;
+	pingOutstanding = false;
 	ofLogNotice("ofWebSocket") << "Connection opened.";
+
+	// panels that are already open switch to binary
+	sendNow(ControlProtocol::capsMessage());
+	schedulePing();
 }
 
 void ofWebSocket::onFail(websocketpp::connection_hdl hdl) {
 	isConnected = false;
 	ofLogError("ofWebSocket") << "Connection failed.";
+	scheduleReconnect();
 }
 
 void ofWebSocket::onClose(websocketpp::connection_hdl hdl) {
 	isConnected = false;
 	ofLogNotice("ofWebSocket") << "Connection closed.";
+	if (pingTimer) {
+		pingTimer->cancel();
+	}
+	if (pongTimer) {
+		pongTimer->cancel();
+	}
+	pingOutstanding = false;
+	scheduleReconnect();
+}
+
+void ofWebSocket::onPong(websocketpp::connection_hdl hdl, std::string payload) {
+	pingOutstanding = false;
+	if (pongTimer) {
+		pongTimer->cancel();
+	}
+
+	uint64_t sent = ofFromString<uint64_t>(payload);
+	uint64_t now  = ofGetElapsedTimeMicros();
+	if (sent == 0 || sent > now) {
+		return;
+	}
+	float ms = (now - sent) / 1000.0f;
+	pingMs   = pingMs == 0.0f ? ms : ofLerp(pingMs, ms, 0.2f);
+}
+
+// no pong within pongTimeoutMs: the connection is gone even if TCP has not noticed yet
+void ofWebSocket::onPongTimeout() {
+	ofLogWarning("ofWebSocket") << "No pong for " << settings.pongTimeoutMs << " ms, reconnecting.";
+	pingOutstanding = false;
+
+	websocketpp::lib::error_code ec;
+	client::connection_ptr       con = wsClient.get_con_from_hdl(connection, ec);
+	if (!ec) {
+		// skips the close handshake, onClose follows and schedules the reconnect
+		con->terminate(websocketpp::lib::error_code());
+	}
 }
 
 void ofWebSocket::send(const std::string &message) {
+	if (serving) {
+		wsServer.set_timer(0, [this, message](const websocketpp::lib::error_code &ec) {
+			if (!ec) {
+				broadcast(message, websocketpp::frame::opcode::text);
+			}
+		});
+		return;
+	}
+	if (!running) {
+		ofLogWarning("ofWebSocket") << "Cannot send message: Not connected.";
+		return;
+	}
+	wsClient.set_timer(0, [this, message](const websocketpp::lib::error_code &ec) {
+		if (!ec) {
+			sendNow(message);
+		}
+	});
+}
+
+// asio thread
+void ofWebSocket::sendNow(const std::string &message) {
 	if (!isConnected) {
 		ofLogWarning("ofWebSocket") << "Cannot send message: Not connected.";
 		return;
@@ -103,18 +389,222 @@ void ofWebSocket::send(const std::string &message) {
 }
 
 void ofWebSocket::close() {
-	if (!isConnected)
+	if (serverThread.joinable()) {
+		serving = false;
+		wsServer.set_timer(0, [this](const websocketpp::lib::error_code &) { shutdownServer(); });
+		serverThread.join();
+		clientCount = 0;
+	}
+
+	if (!clientThread.joinable()) {
 		return;
+	}
+
+	running = false;
+	wsClient.set_timer(0, [this](const websocketpp::lib::error_code &) { shutdown(); });
+	clientThread.join();
+
+	isConnected = false;
+}
+
+// server mode ------------------------------------------------------------------------------
+
+void ofWebSocket::listen(uint16_t port, const std::string &panelPath) {
+	close();
+
+	// the served panel connects back to the host it was loaded from, not to the hosted relay
+	ofBuffer html = ofBufferFromFile(panelPath);
+	panelHtml     = html.getText();
+	if (panelHtml.empty()) {
+		ofLogWarning("ofWebSocket") << "No control panel at " << panelPath << ", serving websockets only.";
+	} else {
+		std::string socket = "<script>window.PANEL_SOCKET = `ws://${location.host}/control`;</script>\n    ";
+		ofStringReplace(panelHtml, "<script>", socket + "<script>");
+	}
 
 	websocketpp::lib::error_code ec;
-	wsClient.close(connection, websocketpp::close::status::normal, "Closing", ec);
+	wsServer.reset();
+	wsServer.listen(port, ec);
+	if (!ec) {
+		wsServer.start_accept(ec);
+	}
 	if (ec) {
-		ofLogError("ofWebSocket") << "Close failed: " << ec.message();
+		ofLogError("ofWebSocket") << "Cannot listen on port " << port << ": " << ec.message();
+		websocketpp::lib::error_code ignored;
+		wsServer.stop_listening(ignored);
+		return;
 	}
 
-	if (clientThread.joinable()) {
-		clientThread.join();
+	clientStates.clear();
+	knownControls   = 0;
+	changedControls = 0;
+	serving         = true;
+	serverThread    = std::thread(&ofWebSocket::runServer, this);
+	wsServer.set_timer(0, [this](const websocketpp::lib::error_code &) { scheduleBroadcast(); });
+
+	ofLogNotice("ofWebSocket") << "Control panel on http://<this host>:" << port << "/";
+}
+
+size_t ofWebSocket::getClientCount() const {
+	return clientCount;
+}
+
+uint64_t ofWebSocket::getRateLimitedCount() const {
+	return rateLimited;
+}
+
+bool ofWebSocket::isServing() const {
+	return serving;
+}
+
+void ofWebSocket::setDisplayLatency(float ms) {
+	displayLatencyMs = ms;
+}
+
+void ofWebSocket::runServer() {
+	try {
+		wsServer.run();
+	} catch (const std::exception &e) {
+		ofLogError("ofWebSocket") << "Server exception: " << e.what();
 	}
+}
 
-	isConnected = false;
+// asio thread: stops accepting, closes every panel and cancels the broadcast, run() then returns
+void ofWebSocket::shutdownServer() {
+	if (broadcastTimer) {
+		broadcastTimer->cancel();
+	}
+
+	websocketpp::lib::error_code ec;
+	wsServer.stop_listening(ec);
+	for (auto &client : clientStates) {
+		wsServer.close(client.first, websocketpp::close::status::going_away, "Closing", ec);
+	}
+}
+
+// asio thread: one binary frame per panel with every control that changed since the last one,
+// except the ones that panel changed itself (echoing them back would fight its own drag)
+void ofWebSocket::scheduleBroadcast() {
+	auto tick = [this](const websocketpp::lib::error_code &ec) {
+		if (ec || !serving) {
+			return;
+		}
+
+		if (changedControls != 0) {
+			knownControls |= changedControls;
+			for (auto &client : clientStates) {
+				std::string frame = encodeControls(changedControls, &client.first);
+				if (!frame.empty()) {
+					websocketpp::lib::error_code sendError;
+					wsServer.send(client.first, frame, websocketpp::frame::opcode::binary, sendError);
+				}
+			}
+			changedControls = 0;
+		}
+
+		// input -> visible, as measured by the app, for the panels to show next to their round trip
+		uint64_t now = ofGetElapsedTimeMicros();
+		if (now - latencySentMicros > 1000000) {
+			latencySentMicros = now;
+			std::string latency = "{\"latency\":" + ofToString(displayLatencyMs.load(), 1) + "}";
+			broadcast(latency, websocketpp::frame::opcode::text);
+		}
+		scheduleBroadcast();
+	};
+	broadcastTimer = wsServer.set_timer(settings.broadcastIntervalMs, tick);
+}
+
+// asio thread, records for the controls in mask, without the ones last set by skip (if any)
+std::string ofWebSocket::encodeControls(uint32_t mask, const websocketpp::connection_hdl *skip) {
+	std::string frame;
+	for (int control = 0; control < ControlProtocol::CONTROL_COUNT; control++) {
+		if (!(mask & (1u << control))) {
+			continue;
+		}
+		const websocketpp::connection_hdl &sender = lastSender[control];
+		if (skip && !sender.owner_before(*skip) && !skip->owner_before(sender)) {
+			continue;
+		}
+		frame.push_back((char)control);
+		frame.push_back((char)(controlState[control] & 0xff));
+		frame.push_back((char)(controlState[control] >> 8));
+	}
+	return frame;
+}
+
+// asio thread
+void ofWebSocket::broadcast(const std::string &message, websocketpp::frame::opcode::value opcode) {
+	for (auto &client : clientStates) {
+		websocketpp::lib::error_code ec;
+		wsServer.send(client.first, message, opcode, ec);
+	}
+}
+
+void ofWebSocket::onHttp(websocketpp::connection_hdl hdl) {
+	server::connection_ptr con      = wsServer.get_con_from_hdl(hdl);
+	const std::string     &resource = con->get_resource();
+	std::string            path     = resource.substr(0, resource.find('?'));
+
+	if ((path == "/" || path == "/index.html") && !panelHtml.empty()) {
+		con->set_status(websocketpp::http::status_code::ok);
+		con->append_header("Content-Type", "text/html; charset=utf-8");
+		con->append_header("Cache-Control", "no-cache");
+		con->set_body(panelHtml);
+	} else {
+		con->set_status(websocketpp::http::status_code::not_found);
+		con->set_body("not found");
+	}
+}
+
+// a new panel gets the caps and the current value of every control it has not seen yet
+void ofWebSocket::onServerOpen(websocketpp::connection_hdl hdl) {
+	ClientState &state = clientStates[hdl];
+	state.tokens       = settings.clientBurst;
+	state.refillMicros = ofGetElapsedTimeMicros();
+	clientCount        = clientStates.size();
+
+	websocketpp::lib::error_code ec;
+	wsServer.send(hdl, ControlProtocol::capsMessage(), websocketpp::frame::opcode::text, ec);
+
+	std::string snapshot = encodeControls(knownControls, nullptr);
+	if (!snapshot.empty()) {
+		wsServer.send(hdl, snapshot, websocketpp::frame::opcode::binary, ec);
+	}
+}
+
+void ofWebSocket::onServerClose(websocketpp::connection_hdl hdl) {
+	clientStates.erase(hdl);
+	clientCount = clientStates.size();
+}
+
+// token bucket per panel: clientRate controls per second, bursts up to clientBurst. A message
+// that does not fit is dropped whole, so one flooding phone costs the render thread at most its
+// share and the others keep getting through.
+void ofWebSocket::onServerMessage(websocketpp::connection_hdl hdl, server::message_ptr msg) {
+	auto client = clientStates.find(hdl);
+	if (client == clientStates.end()) {
+		return;
+	}
+
+	const std::string &payload  = msg->get_payload();
+	bool               isBinary = msg->get_opcode() == websocketpp::frame::opcode::binary;
+	float              cost     = isBinary ? std::max<size_t>(1, payload.size() / ControlProtocol::RECORD_SIZE) : 1;
+
+	ClientState &state  = client->second;
+	uint64_t     now    = ofGetElapsedTimeMicros();
+	float        refill = (now - state.refillMicros) * settings.clientRate / 1e6f;
+
+	state.tokens       = std::min(settings.clientBurst, state.tokens + refill);
+	state.refillMicros = now;
+	if (state.tokens < cost) {
+		rateLimited++;
+		return;
+	}
+	state.tokens -= cost;
+
+	if (isBinary) {
+		decodeBinary(hdl, payload);
+	} else {
+		parsePayload(hdl, payload);
+	}
 }
@@ -1,45 +1,166 @@
 #pragma once
 
+#include "ControlProtocol.h"
+#include "SpscQueue.h"
 #include "ofMain.h"
 #include <atomic>
 #include <functional>
+#include <map>
 #include <thread>
 #include <websocketpp/client.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/server.hpp>
 
+// Remote control link, in one of two modes:
+//   client  connect(): websocketpp client on its own asio thread that keeps itself connected to a
+//           relay. A failed or dropped connection is retried with exponential backoff, and a ping
+//           every pingIntervalMs measures the round trip and turns a silent, half-open connection
+//           into a reconnect after pongTimeoutMs.
+//   server  listen(): serves index.html over HTTP and takes the panels' websockets directly, so
+//           phones on the LAN skip the relay. Each panel is rate limited by a token bucket, and
+//           control changes are broadcast to the other panels every broadcastIntervalMs.
+// Either way every handler and timer runs on the one network thread, which is the producer of
+// the command queue; send() and close() hand over to it.
 class ofWebSocket {
 public:
+	struct Settings {
+		int reconnectMinMs = 250;
+		int reconnectMaxMs = 10000;
+		int pingIntervalMs = 1000;
+		int pongTimeoutMs = 3000;
+
+		// server mode
+		float clientRate = 120.0f; // controls per second and panel
+		float clientBurst = 60.0f;
+		int broadcastIntervalMs = 33;
+	};
+
+	// read when connect() / listen() is called
+	Settings settings;
+
 	ofWebSocket();
 	~ofWebSocket();
 
+	// starts the asio thread and keeps connecting to uri until close()
 	void connect(const std::string & uri);
+	// serves the panel at panelPath and control websockets on port until close()
+	void listen(uint16_t port, const std::string & panelPath);
+	// client: to the relay; server: to every panel
 	void send(const std::string & message);
+	// closes the connection(s), stops retrying and joins the thread; either mode may start again
 	void close();
 
 	std::function<void(const std::string &)> onMessage;
 
-	struct ParsedData {
-		std::string id;
-		int param;
-		int total_parameters;
+	// one control change, from either a JSON or a binary message
+	struct ControlCommand {
+		uint8_t control = 0; // ControlProtocol id
+		uint16_t value = 0;
+		uint64_t receivedMicros = 0; // ofGetElapsedTimeMicros() on arrival
 	};
 
-	ParsedData parsedData;
+	// render thread: takes the oldest command the network thread parsed, false when none is left
+	bool poll(ControlCommand & command);
+
+	size_t getQueueDepth() const;
+	uint64_t getReceivedCount() const;
+	uint64_t getDroppedCount() const; // queue was full
+	uint64_t getInvalidCount() const; // payloads that did not parse
+	uint64_t getBinaryCount() const; // commands that came in binary frames
+	uint64_t getReconnectCount() const; // connection attempts after the first
+	float getPingMs() const; // smoothed round trip, 0 before the first pong
+
+	const std::string & getUri() const;
+
+	bool isServing() const;
+	size_t getClientCount() const; // panels connected in server mode
+	uint64_t getRateLimitedCount() const; // messages over a panel's rate
+
+	// render thread: input -> visible latency as the app measured it, sent to the panels once a second
+	void setDisplayLatency(float ms);
+
 	std::atomic<bool> isConnected;
 
 private:
 	using client = websocketpp::client<websocketpp::config::asio_client>;
 	using message_ptr = websocketpp::config::asio_client::message_type::ptr;
+	using server = websocketpp::server<websocketpp::config::asio>;
 
 	client wsClient;
-	websocketpp::connection_hdl connection;
 	std::thread clientThread;
+	std::string uri;
+	std::atomic<bool> running { false };
+
+	// asio thread only
+	websocketpp::connection_hdl connection;
+	client::timer_ptr reconnectTimer;
+	client::timer_ptr pingTimer;
+	client::timer_ptr pongTimer;
+	bool pingOutstanding = false; // sent, no pong yet
+	int backoffMs = 0;
+	bool attempted = false;
+
+	// server mode
+	struct ClientState {
+		float tokens = 0.0f;
+		uint64_t refillMicros = 0;
+	};
+
+	server wsServer;
+	std::thread serverThread;
+	std::atomic<bool> serving { false };
+	std::atomic<size_t> clientCount { 0 };
+	std::atomic<uint64_t> rateLimited { 0 };
+	std::atomic<float> displayLatencyMs { 0.0f };
+	std::string panelHtml;
+
+	// server thread only
+	std::map<websocketpp::connection_hdl, ClientState, std::owner_less<websocketpp::connection_hdl>> clientStates;
+	uint16_t controlState[ControlProtocol::CONTROL_COUNT] {};
+	websocketpp::connection_hdl lastSender[ControlProtocol::CONTROL_COUNT];
+	uint32_t knownControls = 0; // bit per control id, sent to new panels
+	uint32_t changedControls = 0; // since the last broadcast
+	server::timer_ptr broadcastTimer;
+	uint64_t latencySentMicros = 0;
+
+	// network thread -> render thread, a frame's worth of slider drags fits many times over
+	SpscQueue<ControlCommand, 256> commands;
+	std::atomic<uint64_t> received { 0 };
+	std::atomic<uint64_t> dropped { 0 };
+	std::atomic<uint64_t> invalid { 0 };
+	std::atomic<uint64_t> binary { 0 };
+	std::atomic<uint64_t> reconnects { 0 };
+	std::atomic<float> pingMs { 0.0f };
 
 	void run();
+	void startConnect();
+	void scheduleReconnect();
+	void schedulePing();
+	void schedulePongTimeout();
+	void shutdown();
+	void sendNow(const std::string & message);
+
 	void onMessageInternal(websocketpp::connection_hdl hdl, message_ptr msg);
 	void onOpen(websocketpp::connection_hdl hdl);
 	void onFail(websocketpp::connection_hdl hdl);
 	void onClose(websocketpp::connection_hdl hdl);
+	void onPong(websocketpp::connection_hdl hdl, std::string payload);
+	void onPongTimeout();
+
+	void runServer();
+	void shutdownServer();
+	void scheduleBroadcast();
+	std::string encodeControls(uint32_t mask, const websocketpp::connection_hdl * skip);
+	void broadcast(const std::string & message, websocketpp::frame::opcode::value opcode);
+
+	void onHttp(websocketpp::connection_hdl hdl);
+	void onServerOpen(websocketpp::connection_hdl hdl);
+	void onServerClose(websocketpp::connection_hdl hdl);
+	void onServerMessage(websocketpp::connection_hdl hdl, server::message_ptr msg);
 
-	void parsePayload(const std::string & payload);
+	void parsePayload(websocketpp::connection_hdl from, const std::string & payload);
+	void decodeBinary(websocketpp::connection_hdl from, const std::string & payload);
+	void queue(websocketpp::connection_hdl from, int control, int value);
+	void reply(websocketpp::connection_hdl to, const std::string & message);
 };
@@ -7,12 +7,19 @@
 
 #pragma once
 
+#include "Benchmark.h"
+#include "DetectorConfig.h"
 #include "ofxOpenCv.h"
 
 #include <opencv2/dnn.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define YOLO_DECODE_SSE
+#endif
+
 // based on code from https://github.com/doleron/yolov5-opencv-cpp-python/
 
 // License is listed as
@@ -48,10 +55,10 @@ public:
 		string      label;
 	};
 
-	// leave these unless your model is expecting different dimmensions
+	// set from DetectorConfig::inputSize, see setInputSize()
 	//(some are 224 x 224) - more info here: https://github.com/ultralytics/yolov5/releases
-	const float INPUT_WIDTH  = 640.0;
-	const float INPUT_HEIGHT = 640.0;
+	float INPUT_WIDTH  = 640.0;
+	float INPUT_HEIGHT = 640.0;
 
 	// higer means less results but more accurate
 	const float SCORE_THRESHOLD      = 0.2;
@@ -61,46 +68,106 @@ public:
 	// enabling CUDA might need a different OpenCV lib built with CUDA support
 	//------------------------------------------------------------------------------------------------------------------------------------
 	void setup(string modelFile, string classesFile, bool useCuda) {
-		// needs OpenCV 4.6 as earier has errors
-		net = cv::dnn::readNetFromONNX(ofToDataPath(modelFile));
+		DetectorConfig config;
+		config.modelFile   = modelFile;
+		config.classesFile = classesFile;
+		config.device      = useCuda ? DetectorConfig::Device::Cuda : DetectorConfig::Device::OpenCL;
+		setup(config);
+	}
 
-		if (useCuda) {
-			std::cout << "Attempt Yolo with CUDA\n";
-			net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
-			net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA_FP16);
-		} else {
-			std::cout << "Running Yolo on CPU with OpenCL if available\n";
-			net.setPreferableBackend(cv::dnn::DNN_BACKEND_DEFAULT);
-			net.setPreferableTarget(cv::dnn::DNN_TARGET_OPENCL);
-		}
+	void setup(const DetectorConfig &detectorConfig) {
+		config = detectorConfig;
+		loadNet(config.modelFor(config.inputSize));
+		setInputSize(config.inputSize);
 
 		// load the classes from text file
 		classes.clear();
-		auto buffer = ofBufferFromFile(classesFile);
+		auto buffer = ofBufferFromFile(config.classesFile);
 		for (auto line : buffer.getLines()) {
 			classes.push_back(line);
 		}
 	}
 
+	// switches the network input resolution, reloading the model if the config has a dedicated file for it.
+	// a single model file only works at other sizes when it was exported with dynamic input axes.
+	void setInputSize(int size) {
+		std::string model = config.modelFor(size);
+		if (model != loadedModel) {
+			loadNet(model);
+		}
+
+		INPUT_WIDTH  = size;
+		INPUT_HEIGHT = size;
+		expectedRows = DetectorConfig::outputRows(size);
+		bRowsChecked = false;
+	}
+
+	int getInputSize() const {
+		return INPUT_WIDTH;
+	}
+
+	const DetectorConfig &getConfig() const {
+		return config;
+	}
+
 	//------------------------------------------------------------------------------------------------------------------------------------
 	vector<Result> classifyFrame(cv::Mat frame) {
-		vector<yolo5ImageClassify::Detection> output;
-		detect(frame, net, output, classes);
+		detect(frame, net, detections, classes);
+		toResults(results);
+		return results;
+	}
 
-		results.clear();
-		for (long unsigned int i = 0; i < output.size(); ++i) {
-			auto detection = output[i];
-			auto box       = detection.box;
-			auto classId   = detection.class_id;
+	// camera pixels go straight into the persistent input blob, out keeps its capacity between frames
+	void classifyFrame(const ofPixels &pixels, vector<Result> &out) {
+		preprocess(pixels);
+		net.setInput(inputBlob);
+		runNet(letterboxSide / INPUT_WIDTH, letterboxSide / INPUT_HEIGHT, detections);
+		toResults(out);
+	}
 
-			Result res;
-			res.rect  = ofRectangle(box.x, box.y, box.width, box.height);
-			res.label = classes[classId];
+	// keeps a copy of the last raw network output so the decoder can be benchmarked on real data
+	void setRecordOutput(bool record) {
+		bRecordOutput = record;
+	}
 
-			results.push_back(res);
+	// compares the reference per-row decode loop with the vectorized decoder on the recorded tensor
+	void benchmarkDecoder(int iterations = 200) {
+		if (recordedOutput.empty()) {
+			ofLogWarning("yolo5ImageClassify") << "No recorded output tensor to benchmark, enable setRecordOutput()";
+			return;
 		}
 
-		return results;
+		int rows, dimensions;
+		outputShape(recordedOutput, rows, dimensions);
+		ofLogNotice("yolo5ImageClassify") << "Decoder benchmark on " << rows << " x " << dimensions << " output";
+
+		Benchmark::run("decode reference", iterations, [&] { decodeOutputReference(recordedOutput, 1.0f, 1.0f); });
+		size_t referenceCount = boxes.size();
+		Benchmark::run("decode simd", iterations, [&] { decodeOutput(recordedOutput, 1.0f, 1.0f); });
+
+		if (boxes.size() != referenceCount) {
+			ofLogError("yolo5ImageClassify") << "Decoder mismatch: " << boxes.size() << " vs " << referenceCount;
+		}
+	}
+
+	// compares format_yolov5 + blobFromImage with the fused preprocess() on the same frame
+	void benchmarkPreprocess(const ofPixels &pixels, int iterations = 100) {
+		if (!pixels.isAllocated() || pixels.getNumChannels() != 3) {
+			return;
+		}
+
+		cv::Mat frame(pixels.getHeight(), pixels.getWidth(), CV_8UC3, (void *)pixels.getData(),
+		              pixels.getBytesStride());
+		cv::Mat reference;
+
+		Benchmark::run("preprocess format_yolov5 + blobFromImage", iterations, [&] {
+			auto input_image = format_yolov5(frame);
+			cv::dnn::blobFromImage(input_image, reference, 1. / 255., cv::Size(INPUT_WIDTH, INPUT_HEIGHT), cv::Scalar(),
+			                       false, false);
+		});
+		Benchmark::run("preprocess fused", iterations, [&] { preprocess(pixels); });
+
+		ofLogNotice("yolo5ImageClassify") << "max abs difference " << cv::norm(reference, inputBlob, cv::NORM_INF);
 	}
 
 protected:
@@ -110,6 +177,46 @@ protected:
 		cv::Rect box;
 	};
 
+	// precomputed horizontal bilinear tap: byte offsets of both source pixels and their weights.
+	// taps that fall into the letterbox padding point at pixel 0 with a weight of 0.
+	struct Tap {
+		int   offset0;
+		int   offset1;
+		float weight0;
+		float weight1;
+	};
+
+	//------------------------------------------------------------------------------------------------------------------------------------
+	void loadNet(const std::string &modelFile) {
+		// needs OpenCV 4.6 as earier has errors
+		net         = cv::dnn::readNetFromONNX(ofToDataPath(modelFile));
+		loadedModel = modelFile;
+
+		cv::dnn::Backend backend = cv::dnn::DNN_BACKEND_OPENCV;
+		cv::dnn::Target  target  = cv::dnn::DNN_TARGET_CPU;
+
+		if (config.device == DetectorConfig::Device::Cuda) {
+			backend = cv::dnn::DNN_BACKEND_CUDA;
+			target  = cv::dnn::DNN_TARGET_CUDA_FP16;
+		} else if (config.device == DetectorConfig::Device::OpenCL) {
+			target = cv::dnn::DNN_TARGET_OPENCL;
+		}
+
+		// say so instead of letting OpenCV fall back on its own
+		auto available = cv::dnn::getAvailableTargets(backend);
+		if (std::find(available.begin(), available.end(), target) == available.end()) {
+			ofLogWarning("yolo5ImageClassify") << DetectorConfig::deviceName(config.device)
+			                                   << " is not available in this OpenCV build, running on the CPU";
+			backend = cv::dnn::DNN_BACKEND_OPENCV;
+			target  = cv::dnn::DNN_TARGET_CPU;
+		}
+
+		net.setPreferableBackend(backend);
+		net.setPreferableTarget(target);
+		ofLogNotice("yolo5ImageClassify") << "Loaded " << modelFile << " (backend " << backend << ", target " << target
+		                                  << ")";
+	}
+
 	//------------------------------------------------------------------------------------------------------------------------------------
 	void detect(cv::Mat &image, cv::dnn::Net &net, std::vector<Detection> &output,
 	            const std::vector<std::string> &className) {
@@ -120,59 +227,273 @@ protected:
 		cv::dnn::blobFromImage(input_image, blob, 1. / 255., cv::Size(INPUT_WIDTH, INPUT_HEIGHT), cv::Scalar(), false,
 		                       false);
 		net.setInput(blob);
-		std::vector<cv::Mat> outputs;
+
+		runNet(input_image.cols / INPUT_WIDTH, input_image.rows / INPUT_HEIGHT, output);
+	}
+
+	void runNet(float x_factor, float y_factor, std::vector<Detection> &output) {
 		net.forward(outputs, net.getUnconnectedOutLayersNames());
 
-		float x_factor = input_image.cols / INPUT_WIDTH;
-		float y_factor = input_image.rows / INPUT_HEIGHT;
+		if (bRecordOutput) {
+			outputs[0].copyTo(recordedOutput);
+		}
 
-		float *data = (float *)outputs[0].data;
+		decodeOutput(outputs[0], x_factor, y_factor);
 
-		const int dimensions = 85;
-		const int rows       = 25200;
+		output.clear();
+		cv::dnn::NMSBoxes(boxes, confidences, SCORE_THRESHOLD, NMS_THRESHOLD, nms_result);
+		for (long unsigned int i = 0; i < nms_result.size(); i++) {
+			int       idx = nms_result[i];
+			Detection result;
+			result.class_id   = class_ids[idx];
+			result.confidence = confidences[idx];
+			result.box        = boxes[idx];
+			output.push_back(result);
+		}
+	}
+
+	void toResults(vector<Result> &out) {
+		out.resize(detections.size());
+		for (size_t i = 0; i < detections.size(); ++i) {
+			const Detection &detection = detections[i];
+			const cv::Rect  &box       = detection.box;
 
-		std::vector<int>      class_ids;
-		std::vector<float>    confidences;
-		std::vector<cv::Rect> boxes;
+			out[i].rect       = ofRectangle(box.x, box.y, box.width, box.height);
+			out[i].confidence = detection.confidence;
+			out[i].label      = detection.class_id < (int)classes.size() ? classes[detection.class_id] : "";
+		}
+	}
+
+	//------------------------------------------------------------------------------------------------------------------------------------
+	// one pass from camera pixels to the NCHW float input: letterbox (image top-left, zero padding),
+	// bilinear resize, optional R/B swap and the 1/255 scale. matches format_yolov5 + blobFromImage
+	// up to rounding. output rows are spread over OpenCV's thread pool.
+	void preprocess(const ofPixels &pixels, bool swapRB = false) {
+		const int srcW     = pixels.getWidth();
+		const int srcH     = pixels.getHeight();
+		const int channels = pixels.getNumChannels();
+		const int stride   = pixels.getBytesStride();
+		const int dstW     = INPUT_WIDTH;
+		const int dstH     = INPUT_HEIGHT;
+
+		const int blobSize[] = { 1, 3, dstH, dstW };
+		inputBlob.create(4, blobSize, CV_32F);
+
+		letterboxSide = std::max(srcW, srcH);
+
+		const float scaleX = letterboxSide / (float)dstW;
+		const float scaleY = letterboxSide / (float)dstH;
+
+		if (xTaps.size() != (size_t)dstW || tapSourceWidth != srcW || tapChannels != channels) {
+			xTaps.resize(dstW);
+			for (int x = 0; x < dstW; x++) {
+				xTaps[x] = makeTap((x + 0.5f) * scaleX - 0.5f, letterboxSide, srcW, channels);
+			}
+			tapSourceWidth = srcW;
+			tapChannels    = channels;
+		}
+
+		const unsigned char *src    = pixels.getData();
+		float               *planes = (float *)inputBlob.data;
+		const size_t         plane  = (size_t)dstW * dstH;
+		const int            red    = swapRB ? 2 : 0;
+		const int            blue   = swapRB ? 0 : 2;
+
+		cv::parallel_for_(cv::Range(0, dstH), [&](const cv::Range &range) {
+			for (int y = range.start; y < range.end; y++) {
+				Tap ty = makeTap((y + 0.5f) * scaleY - 0.5f, letterboxSide, srcH, 1);
+
+				const unsigned char *row0 = src + (size_t)ty.offset0 * stride;
+				const unsigned char *row1 = src + (size_t)ty.offset1 * stride;
+				const float          w0   = ty.weight0 * (1.0f / 255.0f);
+				const float          w1   = ty.weight1 * (1.0f / 255.0f);
+
+				float *outR = planes + (size_t)y * dstW;
+				float *outG = outR + plane;
+				float *outB = outG + plane;
+
+				for (int x = 0; x < dstW; x++) {
+					const Tap &tx = xTaps[x];
+
+					const unsigned char *p00 = row0 + tx.offset0;
+					const unsigned char *p01 = row0 + tx.offset1;
+					const unsigned char *p10 = row1 + tx.offset0;
+					const unsigned char *p11 = row1 + tx.offset1;
+
+					float a = tx.weight0 * w0, b = tx.weight1 * w0;
+					float c = tx.weight0 * w1, d = tx.weight1 * w1;
+
+					outR[x] = a * p00[red] + b * p01[red] + c * p10[red] + d * p11[red];
+					outG[x] = a * p00[1] + b * p01[1] + c * p10[1] + d * p11[1];
+					outB[x] = a * p00[blue] + b * p01[blue] + c * p10[blue] + d * p11[blue];
+				}
+			}
+		});
+	}
+
+	// same sampling as cv::resize INTER_LINEAR on the letterboxed square of size side
+	static Tap makeTap(float f, int side, int valid, int step) {
+		int   i0 = std::floor(f);
+		float w1 = f - i0;
+		if (i0 < 0) {
+			i0 = 0;
+			w1 = 0.0f;
+		}
+		int i1 = std::min(i0 + 1, side - 1);
+
+		Tap tap;
+		tap.weight0 = i0 < valid ? 1.0f - w1 : 0.0f;
+		tap.weight1 = i1 < valid ? w1 : 0.0f;
+		tap.offset0 = i0 < valid ? i0 * step : 0;
+		tap.offset1 = i1 < valid ? i1 * step : 0;
+		return tap;
+	}
+
+	//------------------------------------------------------------------------------------------------------------------------------------
+	// output is [1 x rows x (5 + classes)]: cx, cy, w, h, objectness, class scores
+	static void outputShape(const cv::Mat &output, int &rows, int &dimensions) {
+		if (output.dims >= 3) {
+			rows       = output.size[output.dims - 2];
+			dimensions = output.size[output.dims - 1];
+		} else {
+			rows       = output.rows;
+			dimensions = output.cols;
+		}
+	}
+
+	// two passes: a vectorized objectness scan collects the surviving rows, then only those
+	// get the class argmax and box conversion. all buffers are members and keep their capacity.
+	void decodeOutput(const cv::Mat &output, float x_factor, float y_factor) {
+		int rows, dimensions;
+		outputShape(output, rows, dimensions);
+
+		// decode every row the tensor has; a different count means the model's input shape is not the
+		// configured size (or not a stock YOLOv5 head), say so once per size
+		if (!bRowsChecked) {
+			if (rows != expectedRows) {
+				ofLogWarning("yolo5ImageClassify") << "Network returned " << rows << " rows, expected " << expectedRows
+				                                   << " for a " << INPUT_WIDTH << " input, decoding all " << rows;
+			}
+			bRowsChecked = true;
+		}
+
+		const float *data       = (const float *)output.data;
+		const int    numClasses = std::min<int>(dimensions - 5, classes.empty() ? dimensions - 5 : classes.size());
+
+		candidateRows.clear();
+		class_ids.clear();
+		confidences.clear();
+		boxes.clear();
+
+		int i = 0;
+#ifdef YOLO_DECODE_SSE
+		const __m128 threshold = _mm_set1_ps(CONFIDENCE_THRESHOLD);
+		for (; i + 4 <= rows; i += 4) {
+			const float *obj  = data + (size_t)i * dimensions + 4;
+			__m128       conf = _mm_set_ps(obj[3 * dimensions], obj[2 * dimensions], obj[dimensions], obj[0]);
+			int          mask = _mm_movemask_ps(_mm_cmpge_ps(conf, threshold));
+			for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+				if (mask & 1) {
+					candidateRows.push_back(i + lane);
+				}
+			}
+		}
+#endif
+		for (; i < rows; i++) {
+			if (data[(size_t)i * dimensions + 4] >= CONFIDENCE_THRESHOLD) {
+				candidateRows.push_back(i);
+			}
+		}
+
+		for (int row : candidateRows) {
+			const float *r = data + (size_t)row * dimensions;
+
+			float maxScore;
+			int   classId = argmax(r + 5, numClasses, maxScore);
+			if (maxScore > SCORE_THRESHOLD) {
+				confidences.push_back(r[4]);
+				class_ids.push_back(classId);
+				boxes.push_back(toBox(r, x_factor, y_factor));
+			}
+		}
+	}
+
+	// the original row-by-row loop, only kept as the benchmark / correctness reference
+	void decodeOutputReference(const cv::Mat &output, float x_factor, float y_factor) {
+		int rows, dimensions;
+		outputShape(output, rows, dimensions);
+
+		const float *data       = (const float *)output.data;
+		const int    numClasses = std::min<int>(dimensions - 5, classes.empty() ? dimensions - 5 : classes.size());
+
+		class_ids.clear();
+		confidences.clear();
+		boxes.clear();
 
 		for (int i = 0; i < rows; ++i) {
 			float confidence = data[4];
 			if (confidence >= CONFIDENCE_THRESHOLD) {
-				float    *classes_scores = data + 5;
-				cv::Mat   scores(1, className.size(), CV_32FC1, classes_scores);
+				cv::Mat   scores(1, numClasses, CV_32FC1, (void *)(data + 5));
 				cv::Point class_id;
 				double    max_class_score;
 				minMaxLoc(scores, 0, &max_class_score, 0, &class_id);
 				if (max_class_score > SCORE_THRESHOLD) {
 					confidences.push_back(confidence);
-
 					class_ids.push_back(class_id.x);
-
-					float x      = data[0];
-					float y      = data[1];
-					float w      = data[2];
-					float h      = data[3];
-					int   left   = int((x - 0.5 * w) * x_factor);
-					int   top    = int((y - 0.5 * h) * y_factor);
-					int   width  = int(w * x_factor);
-					int   height = int(h * y_factor);
-					boxes.push_back(cv::Rect(left, top, width, height));
+					boxes.push_back(toBox(data, x_factor, y_factor));
 				}
 			}
 
 			data += dimensions;
 		}
+	}
 
-		std::vector<int> nms_result;
-		cv::dnn::NMSBoxes(boxes, confidences, SCORE_THRESHOLD, NMS_THRESHOLD, nms_result);
-		for (long unsigned int i = 0; i < nms_result.size(); i++) {
-			int       idx = nms_result[i];
-			Detection result;
-			result.class_id   = class_ids[idx];
-			result.confidence = confidences[idx];
-			result.box        = boxes[idx];
-			output.push_back(result);
+	static cv::Rect toBox(const float *row, float x_factor, float y_factor) {
+		float x      = row[0];
+		float y      = row[1];
+		float w      = row[2];
+		float h      = row[3];
+		int   left   = int((x - 0.5 * w) * x_factor);
+		int   top    = int((y - 0.5 * h) * y_factor);
+		int   width  = int(w * x_factor);
+		int   height = int(h * y_factor);
+		return cv::Rect(left, top, width, height);
+	}
+
+	// index of the first maximum, same tie-breaking as minMaxLoc
+	static int argmax(const float *values, int count, float &maxValue) {
+		if (count <= 0) {
+			maxValue = 0.0f;
+			return 0;
+		}
+
+		float best = values[0];
+		int   j    = 1;
+#ifdef YOLO_DECODE_SSE
+		if (count >= 8) {
+			__m128 m0 = _mm_loadu_ps(values);
+			__m128 m1 = _mm_loadu_ps(values + 4);
+			for (j = 8; j + 8 <= count; j += 8) {
+				m0 = _mm_max_ps(m0, _mm_loadu_ps(values + j));
+				m1 = _mm_max_ps(m1, _mm_loadu_ps(values + j + 4));
+			}
+			m0 = _mm_max_ps(m0, m1);
+			m0 = _mm_max_ps(m0, _mm_shuffle_ps(m0, m0, _MM_SHUFFLE(1, 0, 3, 2)));
+			m0 = _mm_max_ps(m0, _mm_shuffle_ps(m0, m0, _MM_SHUFFLE(2, 3, 0, 1)));
+			best = _mm_cvtss_f32(m0);
 		}
+#endif
+		for (; j < count; j++) {
+			best = std::max(best, values[j]);
+		}
+
+		maxValue = best;
+		for (int k = 0; k < count; k++) {
+			if (values[k] == best) {
+				return k;
+			}
+		}
+		return 0;
 	}
 
 	//------------------------------------------------------------------------------------------------------------------------------------
@@ -186,7 +507,31 @@ protected:
 	}
 
 
+	DetectorConfig config;
 	cv::dnn::Net   net;
+	std::string    loadedModel;
 	vector<string> classes;
 	vector<Result> results;
+
+	int  expectedRows = DetectorConfig::outputRows(640);
+	bool bRowsChecked = false;
+
+	// decode state, reused across frames
+	std::vector<cv::Mat>   outputs;
+	std::vector<int>       candidateRows;
+	std::vector<int>       class_ids;
+	std::vector<float>     confidences;
+	std::vector<cv::Rect>  boxes;
+	std::vector<int>       nms_result;
+	std::vector<Detection> detections;
+
+	bool    bRecordOutput = false;
+	cv::Mat recordedOutput;
+
+	// preprocessing state, allocated once
+	cv::Mat          inputBlob;
+	std::vector<Tap> xTaps;
+	int              tapSourceWidth = 0;
+	int              tapChannels    = 0;
+	int              letterboxSide  = 0;
 };
@@ -0,0 +1,191 @@
+// Local stand-in for the control relay, so remote control can be tested without the network:
+//
+//   make wsControlServer
+//   bin/wsControlServer [--port 9002] [--echo] [--rate N] [--batch K] [--drop-every S]
+//   bin/pong42 --control ws://localhost:9002/of-ws
+//   open index.html?ws=ws://localhost:9002/client-ws
+//
+// Every message from a client is relayed to all other clients (to the sender as well with
+// --echo), like the hosted relay between the panels and the app. --rate sends N generated binary
+// control frames per second with K slider records each to every client, to load the app's
+// decoder and queue; --drop-every closes all connections every S seconds to exercise the
+// client's reconnect. Prints clients and message rates once per second.
+
+#include "../src/ControlProtocol.h"
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <set>
+#include <string>
+
+using server      = websocketpp::server<websocketpp::config::asio>;
+using message_ptr = server::message_ptr;
+using hdl_set     = std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl> >;
+
+struct Options {
+	uint16_t port      = 9002;
+	bool     echo      = false;
+	int      rate      = 0; // generated frames per second, 0 = relay only
+	int      batch     = 4; // records per generated frame
+	int      dropEvery = 0; // seconds, 0 = never
+};
+
+class ControlServer {
+public:
+	explicit ControlServer(const Options &options) : options(options) {
+		endpoint.clear_access_channels(websocketpp::log::alevel::all);
+		endpoint.set_access_channels(websocketpp::log::alevel::connect | websocketpp::log::alevel::disconnect);
+		endpoint.init_asio();
+		endpoint.set_reuse_addr(true);
+
+		endpoint.set_open_handler([this](websocketpp::connection_hdl hdl) { clients.insert(hdl); });
+		endpoint.set_close_handler([this](websocketpp::connection_hdl hdl) { clients.erase(hdl); });
+		endpoint.set_message_handler([this](websocketpp::connection_hdl hdl, message_ptr msg) { relay(hdl, msg); });
+	}
+
+	void run() {
+		endpoint.listen(options.port);
+		endpoint.start_accept();
+		std::printf("listening on ws://localhost:%d\n", options.port);
+
+		start = std::chrono::steady_clock::now();
+		tick();
+		report();
+		endpoint.run();
+	}
+
+private:
+	Options options;
+	server  endpoint;
+	hdl_set clients;
+
+	std::chrono::steady_clock::time_point start;
+
+	uint64_t relayedIn  = 0;
+	uint64_t relayedOut = 0;
+	uint64_t generated  = 0;
+	uint64_t seconds    = 0;
+	uint16_t phase      = 0;
+
+	// counts at the last report
+	uint64_t reportedIn        = 0;
+	uint64_t reportedOut       = 0;
+	uint64_t reportedGenerated = 0;
+
+	void relay(websocketpp::connection_hdl from, message_ptr msg) {
+		relayedIn++;
+		for (const websocketpp::connection_hdl &to : clients) {
+			bool self = !from.owner_before(to) && !to.owner_before(from);
+			if (self && !options.echo) {
+				continue;
+			}
+			websocketpp::lib::error_code ec;
+			endpoint.send(to, msg->get_payload(), msg->get_opcode(), ec);
+			if (!ec) {
+				relayedOut++;
+			}
+		}
+	}
+
+	// generated load: on a 1 ms timer, as many frames as the rate asks for by now
+	void tick() {
+		if (options.rate <= 0) {
+			return;
+		}
+		double   elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		uint64_t due     = (uint64_t)(elapsed * options.rate);
+		while (generated < due) {
+			sendGenerated();
+			generated++;
+		}
+		endpoint.set_timer(1, [this](const websocketpp::lib::error_code &ec) {
+			if (!ec) {
+				tick();
+			}
+		});
+	}
+
+	// sweeps sliders 1 .. 8 over 0 .. 1000; spacing (0) and the texture map (9) are left alone, they
+	// regenerate particles / load a file on every change
+	void sendGenerated() {
+		std::string frame;
+		frame.reserve(options.batch * ControlProtocol::RECORD_SIZE);
+		for (int i = 0; i < options.batch; i++) {
+			uint16_t value = (phase + i * 97) % 1001;
+			frame.push_back((char)ControlProtocol::slider(1 + i % 8));
+			frame.push_back((char)(value & 0xff));
+			frame.push_back((char)(value >> 8));
+		}
+		phase = (phase + 7) % 1001;
+
+		for (const websocketpp::connection_hdl &to : clients) {
+			websocketpp::lib::error_code ec;
+			endpoint.send(to, frame, websocketpp::frame::opcode::binary, ec);
+		}
+	}
+
+	void report() {
+		std::printf("%llus  clients %zu  relayed in %llu/s out %llu/s  generated %llu/s\n", (unsigned long long)seconds,
+		            clients.size(), (unsigned long long)(relayedIn - reportedIn),
+		            (unsigned long long)(relayedOut - reportedOut),
+		            (unsigned long long)(generated - reportedGenerated));
+		std::fflush(stdout);
+		reportedIn        = relayedIn;
+		reportedOut       = relayedOut;
+		reportedGenerated = generated;
+
+		if (options.dropEvery > 0 && seconds > 0 && seconds % options.dropEvery == 0) {
+			std::printf("dropping %zu connections\n", clients.size());
+			hdl_set dropping = clients;
+			for (const websocketpp::connection_hdl &hdl : dropping) {
+				websocketpp::lib::error_code ec;
+				endpoint.close(hdl, websocketpp::close::status::going_away, "drop test", ec);
+			}
+		}
+		seconds++;
+
+		endpoint.set_timer(1000, [this](const websocketpp::lib::error_code &ec) {
+			if (!ec) {
+				report();
+			}
+		});
+	}
+};
+
+int main(int argc, char *argv[]) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg  = argv[i];
+		bool        more = i + 1 < argc;
+		if (arg == "--port" && more) {
+			options.port = (uint16_t)std::atoi(argv[++i]);
+		} else if (arg == "--echo") {
+			options.echo = true;
+		} else if (arg == "--rate" && more) {
+			options.rate = std::atoi(argv[++i]);
+		} else if (arg == "--batch" && more) {
+			options.batch = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--drop-every" && more) {
+			options.dropEvery = std::atoi(argv[++i]);
+		} else {
+			std::fprintf(stderr,
+			             "usage: %s [--port 9002] [--echo] [--rate N] [--batch K] [--drop-every S]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	try {
+		ControlServer server(options);
+		server.run();
+	} catch (const std::exception &e) {
+		std::fprintf(stderr, "wsControlServer: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}